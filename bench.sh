@@ -0,0 +1,12 @@
+# compare the generational heap with plain mark-sweep on allocation-heavy code,
+# each also with incremental marking of the old space
+codes=`find bench/*.ho`
+
+for src in $codes; do
+  for gc in "--gc=marksweep" "--gc=generational" \
+            "--gc=marksweep --gc-pause=0.5" "--gc=generational --gc-pause=0.5"; do
+    echo "$src $gc:"
+    ( time build/ho $src $gc --gc-stats > /dev/null ) 2>&1 | grep -v "^$"
+    echo
+  done
+done
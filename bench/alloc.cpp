@@ -0,0 +1,100 @@
+// slab allocator against malloc: throughput of allocate/free rounds in the
+// sizes of runtime cells, and memory held after a million-cell churn
+#include "holang/object.hpp"
+#include "holang/slab.hpp"
+#include "holang/string.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <malloc.h>
+#include <random>
+#include <vector>
+
+using namespace std;
+using namespace holang;
+
+namespace {
+const size_t sizes[] = {sizeof(Object), sizeof(String), sizeof(Klass),
+                        sizeof(Func)};
+const size_t rounds = 20;
+const size_t cells = 100000;
+const size_t live_cells = 100000;
+const size_t churn = 1000000;
+
+struct Malloc {
+  void *allocate(size_t size) { return malloc(size); }
+  void free(void *cell, size_t) { ::free(cell); }
+};
+
+template <class Allocator> double throughput(Allocator &allocator) {
+  vector<void *> live(cells);
+  auto begin = chrono::steady_clock::now();
+  for (size_t r = 0; r < rounds; r++) {
+    for (size_t i = 0; i < cells; i++) {
+      live[i] = allocator.allocate(sizes[i % 4]);
+    }
+    for (size_t i = 0; i < cells; i++) {
+      allocator.free(live[i], sizes[i % 4]);
+    }
+  }
+  chrono::duration<double> elapsed = chrono::steady_clock::now() - begin;
+  return rounds * cells / elapsed.count() / 1e6;
+}
+
+// runtime cell sizes, some grown to odd sizes
+size_t random_size(mt19937 &random) {
+  return sizes[random() % 4] + random() % 4 * 24;
+}
+
+// replaces random cells of a live set with cells of random size
+template <class Allocator> size_t do_churn(Allocator &allocator) {
+  mt19937 random(42);
+  vector<pair<void *, size_t>> live(live_cells);
+  size_t live_bytes = 0;
+  for (auto &cell : live) {
+    cell.second = random_size(random);
+    cell.first = allocator.allocate(cell.second);
+    live_bytes += cell.second;
+  }
+  for (size_t i = 0; i < churn; i++) {
+    auto &cell = live[random() % live_cells];
+    allocator.free(cell.first, cell.second);
+    live_bytes -= cell.second;
+    cell.second = random_size(random);
+    cell.first = allocator.allocate(cell.second);
+    live_bytes += cell.second;
+  }
+  return live_bytes;
+}
+} // namespace
+
+int main() {
+  cout << fixed << setprecision(1);
+
+  {
+    Malloc heap;
+    cout << "malloc: " << throughput(heap) << " M allocations/s" << endl;
+  }
+  {
+    SlabAllocator slabs;
+    cout << "slabs:  " << throughput(slabs) << " M allocations/s" << endl;
+  }
+
+  {
+    Malloc heap;
+    size_t live = do_churn(heap);
+    struct mallinfo2 info = mallinfo2();
+    cout << "malloc after churn: " << live / 1024 << " KiB requested, "
+         << info.uordblks / 1024 << " KiB in use, " << info.arena / 1024
+         << " KiB held" << endl;
+  }
+  {
+    SlabAllocator slabs;
+    size_t live = do_churn(slabs);
+    cout << "slabs after churn:  " << live / 1024 << " KiB requested, "
+         << slabs.live_bytes() / 1024 << " KiB in use, "
+         << slabs.slab_bytes() / 1024 << " KiB held" << endl;
+  }
+  return 0;
+}
@@ -0,0 +1,140 @@
+// compiling a program of many imported modules, each parsed on the
+// importing thread or ahead on a number of loader threads, or loaded from
+// the bytecode cache
+#include "holang/heap.hpp"
+#include "holang/loader.hpp"
+#include <chrono>
+#include <cstdio>
+#include <dirent.h>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace holang;
+
+namespace {
+const int runs = 5;
+const int modules = 64;
+const int shared = 8; // imported by the others
+const int funcs = 200;
+const string dir = "./import_bench";
+const string cache_dir = dir + "/cache";
+
+string module_path(const string &name) { return dir + "/" + name + ".ho"; }
+
+void generate_module(const string &name, const string &import) {
+  ofstream out(module_path(name));
+  if (!import.empty()) {
+    out << "import \"" << module_path(import) << "\"\n";
+  }
+  for (int i = 0; i < funcs; i++) {
+    string n = to_string(i);
+    out << "func " << name << "_" << n << "(width, height) {\n"
+        << "  total = width * height + " << n << "\n"
+        << "  if total > 1000 {\n"
+        << "    return \"large number " << n << "\"\n"
+        << "  }\n"
+        << "  while total < 10 {\n"
+        << "    total += 1\n"
+        << "  }\n"
+        << "  total\n"
+        << "}\n";
+  }
+}
+
+vector<string> generate() {
+  mkdir(dir.c_str(), 0755);
+  vector<string> targets;
+  for (int i = 0; i < shared; i++) {
+    generate_module("shared" + to_string(i), "");
+  }
+  for (int i = 0; i < modules; i++) {
+    string name = "module" + to_string(i);
+    generate_module(name, "shared" + to_string(i % shared));
+    targets.push_back(module_path(name));
+  }
+  return targets;
+}
+
+void cleanup() {
+  for (int i = 0; i < shared; i++) {
+    remove(module_path("shared" + to_string(i)).c_str());
+  }
+  for (int i = 0; i < modules; i++) {
+    remove(module_path("module" + to_string(i)).c_str());
+  }
+  if (DIR *cache = opendir(cache_dir.c_str())) {
+    while (struct dirent *entry = readdir(cache)) {
+      remove((cache_dir + "/" + entry->d_name).c_str());
+    }
+    closedir(cache);
+  }
+  rmdir(cache_dir.c_str());
+  rmdir(dir.c_str());
+}
+
+// what IMPORT does up to running the module, which imports the rest first
+void import(ModuleLoader &loader, const string &target) {
+  string path = ModuleLoader::resolve(target);
+  if (loader.is_loaded(path)) {
+    return;
+  }
+  loader.add_loaded(path, nullptr); // the code is not kept
+  unique_ptr<ParsedModule> module = loader.take(path);
+  if (module == nullptr) {
+    module = ModuleLoader::parse(path);
+    loader.preload(module->imports);
+  }
+  CodeSequence codes(path);
+  vector<string> imports = module->imports;
+  ModuleLoader::compile(move(module), codes);
+  for (const auto &import_target : imports) {
+    import(loader, import_target);
+  }
+}
+
+double seconds(const vector<string> &targets, unsigned workers) {
+  double best = 1e9;
+  for (int i = 0; i < runs; i++) {
+    auto begin = chrono::steady_clock::now();
+    {
+      ModuleLoader loader;
+      loader.set_workers(workers);
+      loader.preload(targets);
+      for (const auto &target : targets) {
+        import(loader, target);
+      }
+    }
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - begin;
+    best = min(best, elapsed.count());
+  }
+  return best;
+}
+} // namespace
+
+int main() {
+  vector<string> targets = generate();
+  Heap::get().pause(); // code generation makes functions
+
+  cout << fixed << setprecision(1);
+  Bytecode::set_cache_dir("");
+  double serial = seconds(targets, 0);
+  cout << "on import: " << serial * 1e3 << " ms" << endl;
+  for (unsigned workers : {1, 2, 4, 8}) {
+    double preloaded = seconds(targets, workers);
+    cout << workers << " loader threads: " << preloaded * 1e3 << " ms, "
+         << serial / preloaded << "x" << endl;
+  }
+
+  Bytecode::set_cache_dir(cache_dir);
+  seconds(targets, 0); // writes the cache, every later run reads it
+  double cached = seconds(targets, 0);
+  cout << "bytecode cache: " << cached * 1e3 << " ms, " << serial / cached
+       << "x" << endl;
+  cleanup();
+  return 0;
+}
@@ -0,0 +1,80 @@
+// lexing throughput over a generated source of some megabytes, from opening
+// the file to the last token
+#include "holang/lexer.hpp"
+#include "holang/scan.hpp"
+#include "holang/source.hpp"
+#include "holang/token.hpp"
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+using namespace std;
+using namespace holang;
+
+namespace {
+const int runs = 10;
+
+void generate(const string &path, size_t size) {
+  ofstream out(path);
+  size_t written = 0;
+  for (int i = 0; written < size; i++) {
+    string n = to_string(i);
+    string chunk = "class Shape" + n + " {\n"
+                   "  func area_" + n + "(width, height) {\n"
+                   "    # scaled by " + n + "\n"
+                   "    total = width * height + " + n + "\n"
+                   "    if total > 1000 {\n"
+                   "      return \"large shape number " + n + "\"\n"
+                   "    }\n"
+                   "    self.Point.new().move(total, 42)\n"
+                   "  }\n"
+                   "}\n";
+    out << chunk;
+    written += chunk.size();
+  }
+}
+
+double throughput(const string &path, size_t &n_tokens, size_t &token_bytes) {
+  double best = 0;
+  size_t size = 0;
+  for (int i = 0; i < runs; i++) {
+    auto begin = chrono::steady_clock::now();
+    SourceFile source(path);
+    TokenBuffer tokens(source.data());
+    Lexer(source.data(), source.size()).lex(tokens);
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - begin;
+    if (i == 0 || elapsed.count() < best) {
+      best = elapsed.count();
+    }
+    n_tokens = tokens.size();
+    token_bytes = tokens.memory_bytes();
+    size = source.size();
+  }
+  return size / 1e6 / best;
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+  size_t megabytes = argc > 1 ? stoul(argv[1]) : 16;
+  string path = "lex_bench.ho";
+  generate(path, megabytes << 20);
+
+  cout << fixed << setprecision(1);
+  string best = scan::isa();
+  for (const char *isa : {"scalar", "sse2", "avx2"}) {
+    if (!scan::select(isa)) {
+      continue;
+    }
+    size_t n_tokens, token_bytes;
+    double mb_per_s = throughput(path, n_tokens, token_bytes);
+    cout << "lex " << isa << ": " << mb_per_s << " MB/s, " << n_tokens
+         << " tokens, " << (double)token_bytes / n_tokens
+         << " bytes per token" << endl;
+  }
+  scan::select(best);
+  remove(path.c_str());
+  return 0;
+}
@@ -0,0 +1,114 @@
+// running short scripts one process each, as a cold ho or through
+// ho-client on a server that has started once
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fcntl.h>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <signal.h>
+#include <spawn.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace std;
+
+namespace {
+const int runs = 200;
+const string dir = "./startup_bench";
+const string socket_path = dir + "/ho.sock";
+
+int spawn(const vector<string> &args, bool quiet) {
+  vector<char *> argv;
+  for (const auto &arg : args) {
+    argv.push_back((char *)arg.c_str());
+  }
+  argv.push_back(nullptr);
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  if (quiet) {
+    posix_spawn_file_actions_addopen(&actions, 1, "/dev/null", O_WRONLY, 0);
+  }
+  pid_t pid;
+  int error = posix_spawn(&pid, argv[0], &actions, nullptr, argv.data(),
+                          environ);
+  posix_spawn_file_actions_destroy(&actions);
+  return error == 0 ? pid : -1;
+}
+
+// microseconds from spawning to the end of the script, median of the runs
+double latency(const vector<string> &args) {
+  vector<double> times;
+  for (int i = 0; i < runs; i++) {
+    auto begin = chrono::steady_clock::now();
+    pid_t pid = spawn(args, true);
+    int status;
+    if (pid < 0 || waitpid(pid, &status, 0) != pid ||
+        !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      cerr << args[0] << " failed" << endl;
+      exit(1);
+    }
+    chrono::duration<double, micro> elapsed =
+        chrono::steady_clock::now() - begin;
+    times.push_back(elapsed.count());
+  }
+  sort(times.begin(), times.end());
+  return times[times.size() / 2];
+}
+
+bool connectable() {
+  struct sockaddr_un address = {};
+  address.sun_family = AF_UNIX;
+  snprintf(address.sun_path, sizeof(address.sun_path), "%s",
+           socket_path.c_str());
+  int conn = socket(AF_UNIX, SOCK_STREAM, 0);
+  bool ok = connect(conn, (struct sockaddr *)&address, sizeof(address)) == 0;
+  close(conn);
+  return ok;
+}
+} // namespace
+
+int main() {
+  mkdir(dir.c_str(), 0755);
+  const vector<pair<string, string>> scripts = {
+      {"hello", "println(\"hello\")\n"},
+      {"holib", "import \"integer.ho\"\nprintln(3)\n"},
+      {"fib", "func fib(n) {\n  if n < 2 {\n    return n\n  }\n"
+              "  fib(n - 1) + fib(n - 2)\n}\nprintln(fib(15))\n"},
+  };
+  for (const auto &script : scripts) {
+    ofstream(dir + "/" + script.first + ".ho") << script.second;
+  }
+
+  // up once it accepts; the child of a connection without a request exits
+  pid_t server = spawn({HO_PATH, "--server", socket_path}, false);
+  while (!connectable()) {
+    usleep(1000);
+  }
+
+  cout << fixed << setprecision(0);
+  cout << "spawning /bin/true: " << latency({"/bin/true"}) << " us" << endl;
+  for (const auto &script : scripts) {
+    string path = dir + "/" + script.first + ".ho";
+    double cold = latency({HO_PATH, path});
+    double served = latency({HO_CLIENT_PATH, socket_path, path});
+    cout << script.first << ": ho " << cold << " us, ho-client " << served
+         << " us, " << setprecision(1) << cold / served << "x"
+         << setprecision(0) << endl;
+  }
+
+  kill(server, SIGTERM);
+  waitpid(server, nullptr, 0);
+  for (const auto &script : scripts) {
+    remove((dir + "/" + script.first + ".ho").c_str());
+  }
+  remove(socket_path.c_str());
+  rmdir(dir.c_str());
+  return 0;
+}
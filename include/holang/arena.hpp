@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace holang {
+// Bump allocator for the syntax tree of one source file. Every cell is
+// destroyed with the arena, once the last function body in it is compiled,
+// so code must not refer to anything made in it; strings it needs are
+// copied with CodeSequence::intern.
+class Arena {
+public:
+  Arena() {}
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+  ~Arena();
+
+  template <class T, class... Args> T *make(Args &&... args) {
+    T *cell = new (allocate(sizeof(T), alignof(T)))
+        T(std::forward<Args>(args)...);
+    if (!std::is_trivially_destructible<T>::value) {
+      destructors.push_back({cell, [](void *p) { ((T *)p)->~T(); }});
+    }
+    return cell;
+  }
+
+  size_t allocated_bytes() const { return bytes; }
+
+private:
+  void *allocate(size_t size, size_t align) {
+    uintptr_t cell = ((uintptr_t)top + align - 1) & ~(uintptr_t)(align - 1);
+    if (cell + size > (uintptr_t)end) {
+      grow(size + align);
+      cell = ((uintptr_t)top + align - 1) & ~(uintptr_t)(align - 1);
+    }
+    top = (char *)cell + size;
+    return (void *)cell;
+  }
+  void grow(size_t size);
+
+private:
+  struct Destructor {
+    void *cell;
+    void (*destroy)(void *);
+  };
+
+  std::vector<char *> chunks;
+  std::vector<Destructor> destructors;
+  char *top = nullptr;
+  char *end = nullptr;
+  size_t bytes = 0;
+  static const size_t chunk_size = 1 << 16;
+};
+} // namespace holang
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "holang/bytecode.hpp"
+#include "holang/source.hpp"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace holang {
+// A program and the modules it imports by string literal targets, compiled
+// by `ho bundle` into one file. The imports of those targets are resolved
+// to the modules in it, so running it reads no other file.
+//
+// Top level functions that no reachable code calls by name are left out,
+// unless a module imports a target made at run time; a call by a name the
+// bundle does not know of raises instead.
+class Bundle {
+public:
+  // raised whenever the format changes; the images have their own version
+  static const uint32_t version = 1;
+
+  struct Stats {
+    size_t modules = 0;
+    size_t functions = 0; // defined at the top level
+    size_t stripped = 0;
+    size_t bytes = 0;
+  };
+
+  // Compiles the program at main and the modules it imports into the
+  // bundle at path. Throws SyntaxError, or std::runtime_error when a module
+  // refers to a value that can not be saved or path can not be written.
+  static Stats write(const std::string &main, const std::string &path);
+
+  static bool is_bundle(const SourceFile &file);
+  // null when file is broken
+  static std::shared_ptr<Bundle> open(std::shared_ptr<const SourceFile> file);
+
+  Bundle(const Bundle &) = delete;
+  Bundle &operator=(const Bundle &) = delete;
+
+  // resolved path of the program
+  const std::string &main_path() const { return paths[0]; }
+  // the code of the module at a resolved path, null when it is not bundled
+  std::shared_ptr<Bytecode> module(const std::string &path) const;
+  // the path target was resolved to when the bundle was made
+  bool resolve(const std::string &target, std::string *path) const;
+
+private:
+  Bundle() {}
+
+private:
+  std::vector<std::string> paths; // of the modules, the program first
+  std::unordered_map<std::string, std::shared_ptr<Bytecode>> modules;
+  std::unordered_map<std::string, std::string> targets;
+};
+} // namespace holang
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "holang/code.hpp"
+#include "holang/source.hpp"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace holang {
+// The code of a source file saved by an earlier run, in the bytecode cache.
+//
+// A .hoc file holds the top level code of a module and every function it
+// reaches. Operands that are pointers at run time are indices instead:
+// strings and method names into a constant pool, functions into the table
+// of the file. The file is named after a hash of the source text, and is
+// only used for a source of the same hash and size by a compiler of the
+// same version built from the same sources, and whose checksum matches. It is mapped, and a function
+// body is only decoded on its first call.
+//
+// The modules of holib are compiled into an image directory when holang is
+// built, by the holib_image target, and found there before the cache.
+class Bytecode : public std::enable_shared_from_this<Bytecode> {
+public:
+  // raised whenever code generation or the format changes
+  static const uint32_t version = 4;
+
+  // FNV-1a of the source text
+  static uint64_t hash(const char *text, size_t size);
+
+  // $HOLANG_CACHE_DIR, else holang in $XDG_CACHE_HOME or ~/.cache; set
+  // before the first load, an empty directory disables the cache
+  static void set_cache_dir(const std::string &dir) { cache_dir() = dir; }
+  static bool enabled() { return !cache_dir().empty(); }
+
+  // The cached code of a source, null when there is none or it is stale.
+  // Does not touch the heap, so loader threads call it too.
+  static std::shared_ptr<Bytecode> load(uint64_t source_hash,
+                                        size_t source_size);
+  // Writes codes and the functions it reaches, compiling the lazy ones.
+  // Nothing is written when the cache is disabled, the directory can not
+  // be written or the code refers to an object other than a string.
+  static void save(const CodeSequence &codes, uint64_t source_hash,
+                   size_t source_size,
+                   const std::vector<std::string> &imports);
+  // The file save writes, in image; false when it can not be written. The
+  // functions in stripped get a body that raises instead of their own.
+  static bool encode(const CodeSequence &codes, uint64_t source_hash,
+                     size_t source_size,
+                     const std::vector<std::string> &imports,
+                     std::string *image,
+                     const std::unordered_set<const Func *> &stripped = {});
+  // The image at offset in a file mapped by the caller, such as a bundle,
+  // whatever source it was compiled from; null when it is broken. Errors
+  // found later name it after path.
+  static std::shared_ptr<Bytecode> open(std::shared_ptr<const SourceFile> file,
+                                        size_t offset, size_t size,
+                                        const std::string &path);
+  // written aside and renamed, so a reader never sees part of a file
+  static bool write_file(const std::string &path, const std::string &data);
+
+  Bytecode(const Bytecode &) = delete;
+  Bytecode &operator=(const Bytecode &) = delete;
+
+  // string literal targets of the imports, unresolved
+  const std::vector<std::string> &imports() const { return import_targets; }
+  // Appends the top level code to codes, whose source path the functions
+  // get too, and makes the functions of the file. The heap has to be
+  // paused until codes is a root. False, with codes cleared, when the file
+  // turns out to be broken: it is then a cache miss.
+  bool instantiate(CodeSequence &codes) const;
+  // removes a broken file from the cache directory; an image of holib or a
+  // bundle is left alone
+  void drop() const;
+
+private:
+  class Reader;
+  class Body;
+  struct Module;
+
+  Bytecode(const std::string &path, std::shared_ptr<const SourceFile> file,
+           size_t offset, size_t size)
+      : path(path), file(std::move(file)), begin(this->file->data() + offset),
+        size(size) {}
+  bool read_header();
+  static std::string &cache_dir();
+  static std::string path_of(const std::string &dir, uint64_t source_hash);
+  // record of the top level code for 0, of function i - 1 for i
+  const char *record(uint32_t index) const;
+  const char *end() const { return begin + size; }
+  bool check(uint32_t index) const;
+  bool decode(uint32_t index, CodeSequence &codes,
+              const std::vector<Func *> &funcs) const;
+
+private:
+  std::string path;
+  std::shared_ptr<const SourceFile> file;
+  const char *begin; // of the image in file
+  size_t size;
+  uint64_t source_hash = 0;
+  uint64_t source_size = 0;
+  std::vector<uint32_t> offsets;
+  std::vector<const std::string *> strings; // interned
+  std::vector<std::string> import_targets;
+};
+} // namespace holang
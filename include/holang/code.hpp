@@ -1,7 +1,10 @@
 #pragma once
 
 #include "holang/instruction.hpp"
+#include <mutex>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 namespace holang {
@@ -13,17 +16,36 @@ union Code {
   int ival;
   double dval;
   bool bval;
-  std::string *sval;
+  const std::string *sval;
   Func *funcval;
   Object *objval;
 };
 
 class CodeSequence {
 public:
-  CodeSequence() {}
+  struct Handler {
+    int begin; // protected range [begin, end)
+    int end;
+    int target; // catch clause, entered with the exception pushed
+    int env;    // class bodies open at the try statement
+  };
+
+  // jump table of a case statement, every target is a pc
+  struct Switch {
+    int low = 0;           // table_switch: targets[value - low]
+    std::vector<int> keys; // sorted, targets[i] is the target of keys[i]
+    std::unordered_map<std::string, int> strings; // index of the target
+    std::vector<int> targets;
+    int otherwise; // no key matched
+  };
+
+  CodeSequence() : source_path(*intern("")) {}
   CodeSequence(const CodeSequence &src)
-      : source_path(src.source_path), sequence(src.sequence) {}
-  CodeSequence(const std::string &source_path) : source_path(source_path) {}
+      : source_path(src.source_path), sequence(src.sequence),
+        handlers(src.handlers), switches(src.switches),
+        n_locals(src.n_locals) {}
+  CodeSequence(const std::string &source_path)
+      : source_path(*intern(source_path)) {}
 
   void append(Instruction op) {
     Code code;
@@ -49,7 +71,7 @@ public:
     sequence.push_back(code);
   }
 
-  void append(std::string *sval) {
+  void append(const std::string *sval) {
     Code code;
     code.sval = sval;
     sequence.push_back(code);
@@ -67,13 +89,48 @@ public:
     sequence.push_back(code);
   }
 
-  std::vector<Code> get_sequence() const { return sequence; }
+  void append(Code code) { sequence.push_back(code); }
+
+  // string operands outlive the syntax tree; equal ones are stored once.
+  // Modules are parsed on several threads, so the set is locked.
+  static const std::string *intern(const std::string &str) {
+    static std::mutex mutex;
+    static std::unordered_set<std::string> strings;
+    std::lock_guard<std::mutex> lock(mutex);
+    return &*strings.insert(str).first;
+  }
+
+  const std::vector<Code> &get_sequence() const { return sequence; }
   size_t size() const { return sequence.size(); }
   Code &at(size_t index) { return sequence[index]; }
+  const Code &at(size_t index) const { return sequence[index]; }
+  void clear() {
+    sequence.clear();
+    handlers.clear();
+    switches.clear();
+  }
+
+  // inner try statements are added first
+  void add_handler(const Handler &handler) { handlers.push_back(handler); }
+  const std::vector<Handler> &get_handlers() const { return handlers; }
+
+  int add_switch(const Switch &table) {
+    switches.push_back(table);
+    return switches.size() - 1;
+  }
+  const Switch &get_switch(int index) const { return switches[index]; }
+  const std::vector<Switch> &get_switches() const { return switches; }
+
+  // number of frame slots including self
+  int local_size() const { return n_locals; }
+  void set_local_size(int size) { n_locals = size; }
 
-  const std::string source_path;
+  const std::string &source_path; // interned
 
 private:
   std::vector<Code> sequence;
+  std::vector<Handler> handlers;
+  std::vector<Switch> switches;
+  int n_locals = 0;
 };
 } // namespace holang
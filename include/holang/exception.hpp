@@ -0,0 +1,35 @@
+#pragma once
+
+#include "holang/value.hpp"
+#include <exception>
+#include <stdexcept>
+#include <string>
+
+namespace holang {
+// A raised holang value on its way to the nearest handler. It only crosses
+// native frames; inside HolangVM::eval handlers are found from the handler
+// tables of CodeSequence.
+class RaiseException : public std::exception {
+public:
+  RaiseException(const Value &value) : value(value) {}
+  const char *what() const noexcept override { return "holang exception"; }
+
+  Value value;
+};
+
+// A resource limit set by the embedder ran out. It is not a holang exception:
+// no handler sees it and it leaves HolangVM::eval through every frame.
+class LimitExceeded : public std::runtime_error {
+public:
+  using std::runtime_error::runtime_error;
+};
+
+// Source text that does not lex or parse. what() is the report printed for
+// it.
+class SyntaxError : public std::runtime_error {
+public:
+  using std::runtime_error::runtime_error;
+};
+
+[[noreturn]] void raise_error(const std::string &message);
+} // namespace holang
@@ -0,0 +1,227 @@
+#pragma once
+
+#include "holang/code.hpp"
+#include "holang/object.hpp"
+#include "holang/slab.hpp"
+#include "holang/string.hpp"
+#include "holang/value.hpp"
+#include <new>
+#include <ostream>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace holang {
+class HolangVM;
+
+// Generational collector owning every Object and Func.
+//
+// Plain objects and strings are bump-allocated in the nursery. A minor
+// collection copies the ones still reachable into the old space and drops the
+// rest without tracing them. The old space is collected by mark-sweep, always
+// right after emptying the nursery. Classes and functions are referred from
+// native closures and code, so they never move and are allocated old.
+//
+// A collection may start in any allocation, so a new cell has to be
+// reachable from a root before the next one is made, and a raw pointer to a
+// young object is stale after it. Roots are the stacks of live VMs, main_obj,
+// the builtin classes and the constants of the code sequences given to
+// add_root.
+//
+// With a pause target the old space is marked incrementally instead: a cycle
+// starts when it outgrows the threshold and advances in slices run by the VM
+// at safepoints (calls and backward jumps), followed by a lazy sweep. Stores
+// into heap cells shade the stored cell while marking, cells made during the
+// cycle are born marked, and the last slice empties the nursery and rescans
+// the roots before sweeping starts.
+class Heap {
+public:
+  static Heap &get() {
+    // constructed on first use, the builtin classes allocate while statics
+    // are initialized
+    static Heap heap;
+    return heap;
+  }
+
+  template <class T, class... Args> T *make(Args &&... args) {
+    bool young = std::is_same<T, Object>::value ||
+                 std::is_same<T, String>::value;
+    if (young && generational) {
+      return ::new (allocate_young(sizeof(T))) T(std::forward<Args>(args)...);
+    }
+    return make_old<T>(std::forward<Args>(args)...);
+  }
+
+  // for cells referred from code, which is not scanned by minor collections
+  template <class T, class... Args> T *make_old(Args &&... args) {
+    T *cell = new T(std::forward<Args>(args)...);
+    try {
+      track(cell);
+    } catch (...) {
+      delete cell; // over the limit
+      throw;
+    }
+    return cell;
+  }
+
+  void collect() { collect(nullptr, nullptr); }
+
+  // memory of old cells, used by operator new of Object and Func
+  void *allocate_old(size_t size) { return slabs.allocate(size); }
+  void free_old(void *cell, size_t size) { slabs.free(cell, size); }
+
+  void add_root(const CodeSequence *codes) { root_codes.push_back(codes); }
+  void add_vm(HolangVM *vm) { vms.push_back(vm); }
+  void remove_vm(HolangVM *vm);
+
+  // 0 means no limit; going over it throws LimitExceeded, except while
+  // paused for the compiler
+  void set_limit(size_t bytes) { limit = bytes; }
+  // VM stacks grown past their first size, counted against the limit too
+  void reserve_stack(size_t size);
+  void release_stack(size_t size) { stack_bytes -= size; }
+  // without the nursery every object is allocated old
+  void set_generational(bool enabled) { generational = enabled; }
+  // longest slice of incremental marking or sweeping in milliseconds, 0
+  // collects the old space in one pause
+  void set_pause_target(double ms) { pause_target = ms; }
+
+  // called by the VM where all its references are on its stack
+  void safepoint() {
+    if (phase != Phase::Idle) {
+      step();
+    }
+  }
+
+  // functions are allocated by the compiler before any root reaches them
+  void pause() { paused++; }
+  void resume() { paused--; }
+
+  bool is_young(const void *cell) const {
+    return young_begin <= (const char *)cell && (const char *)cell < young_end;
+  }
+
+  // holder now refers to value; an old holder of a young value is scanned
+  // by the next minor collection
+  void write_barrier(Object *holder, Object *value) {
+    if (is_young(value) && !holder->remembered && !is_young(holder)) {
+      holder->remembered = true;
+      remembered.push_back(holder);
+    }
+    if (phase == Phase::Marking) {
+      mark(value);
+    }
+  }
+  void write_barrier(Func *value) {
+    if (phase == Phase::Marking) {
+      mark(value);
+    }
+  }
+  // code compiled into a function that may be marked already
+  void write_barrier(const CodeSequence &codes) {
+    if (phase == Phase::Marking) {
+      mark(codes);
+    }
+  }
+
+  // major collection
+  void mark(Object *obj);
+  void mark(Func *func);
+  void mark(const Value &value);
+  void mark(const CodeSequence &codes);
+
+  // minor collection, ref is updated to the promoted copy
+  void forward(Object *&ref);
+  void forward(Value &value);
+
+  void print_stats(std::ostream &out) const;
+
+private:
+  struct alignas(16) YoungHeader {
+    size_t size; // including the header
+  };
+  enum class Phase { Idle, Marking, Sweeping };
+
+  Heap() {}
+  void *allocate_young(size_t size) {
+    size_t cell = (sizeof(YoungHeader) + size + 15) & ~(size_t)15;
+    if ((size_t)(young_end - young_top) < cell) {
+      collect_young();
+    }
+    auto *header = (YoungHeader *)young_top;
+    header->size = cell;
+    young_top += cell;
+    return header + 1;
+  }
+  void collect_young();
+  void minor_collect();
+  void track(Object *obj);
+  void track(Func *func);
+  void reserve(size_t size, Object *new_obj, Func *new_func);
+  void collect_old(size_t size, Object *new_obj, Func *new_func);
+  void collect(Object *new_obj, Func *new_func);
+  void mark_roots();
+  void trace();
+  void sweep();
+  void start_sweep();
+  void finish_sweep();
+
+  // incremental cycle
+  void step();
+  void start_cycle();
+  void finish_marking();
+  bool trace_some(size_t budget);
+  bool sweep_some(size_t budget);
+
+private:
+  SlabAllocator slabs;
+  std::vector<std::pair<Object *, size_t>> objects;
+  std::vector<std::pair<Func *, size_t>> funcs;
+  std::vector<Object *> gray_objects;
+  std::vector<Func *> gray_funcs;
+  std::vector<Object *> promoted_objects; // to be scanned by minor_collect
+  std::vector<Object *> remembered; // old objects referring to young ones
+  std::vector<const CodeSequence *> root_codes;
+  std::vector<HolangVM *> vms;
+  unsigned epoch = 0; // a cell is marked when its gc_mark equals this
+  int paused = 0;
+
+  bool generational = true;
+  char *young_begin = nullptr; // nursery, allocated on first use
+  char *young_top = nullptr;
+  char *young_end = nullptr;
+  static const size_t nursery_size = 1 << 19;
+
+  size_t bytes = 0; // old space
+  size_t stack_bytes = 0;
+  size_t next_gc = initial_threshold;
+  size_t limit = 0;
+  static const size_t initial_threshold = 1 << 20;
+
+  double pause_target = 0;
+  Phase phase = Phase::Idle;
+  size_t swept_objects = 0; // sweep cursors, cells past the ends are new
+  size_t swept_funcs = 0;
+  size_t sweep_objects_end = 0;
+  size_t sweep_funcs_end = 0;
+  double last_step = 0; // end of the previous slice in milliseconds
+
+  // --gc-stats
+  size_t collections = 0;
+  size_t minor_collections = 0;
+  size_t freed = 0;
+  size_t promoted = 0;
+  size_t peak_bytes = 0;
+  std::vector<double> pauses; // major pauses and slices in milliseconds
+  std::vector<double> minor_pauses;
+};
+
+// the heap paused until the end of the scope, however it is left
+class HeapPause {
+public:
+  HeapPause() { Heap::get().pause(); }
+  ~HeapPause() { Heap::get().resume(); }
+  HeapPause(const HeapPause &) = delete;
+  HeapPause &operator=(const HeapPause &) = delete;
+};
+} // namespace holang
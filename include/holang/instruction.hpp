@@ -10,21 +10,31 @@ enum class Instruction {
   PUT_BOOL,
   PUT_STRING,
   PUT_LAMBDA,
+  PUT_OBJECT,
   POP,
   ADD,
   SUB,
   MUL,
   DIV,
   MOD,
+  SHL,
   LESS,
   GREATER,
   EQUAL,
   STORE_LOCAL,
   LOAD_LOCAL,
+  ADD_LOCAL_CONST,
+  INC_LOCAL,
+  SUB_LOCAL_CONST,
+  DEC_LOCAL,
   JUMP,
   JUMP_IF,
   JUMP_IFNOT,
+  TABLE_SWITCH,
+  LOOKUP_SWITCH,
+  HASH_SWITCH,
   CALL_FUNC,
+  CALL_DIRECT,
   RET,
   PUT_SELF,
   DEF_FUNC,
@@ -32,6 +42,7 @@ enum class Instruction {
   PREV_ENV,
   LOAD_OBJ_FIELD,
   IMPORT,
+  RAISE,
 };
 
 static std::ostream &operator<<(std::ostream &out,
@@ -47,6 +58,8 @@ static std::ostream &operator<<(std::ostream &out,
     return out << "PUT_STRING";
   case Instruction::PUT_LAMBDA:
     return out << "PUT_LAMBDA";
+  case Instruction::PUT_OBJECT:
+    return out << "PUT_OBJECT";
   case Instruction::POP:
     return out << "POP";
   case Instruction::ADD:
@@ -59,6 +72,8 @@ static std::ostream &operator<<(std::ostream &out,
     return out << "DIV";
   case Instruction::MOD:
     return out << "MOD";
+  case Instruction::SHL:
+    return out << "SHL";
   case Instruction::LESS:
     return out << "LESS";
   case Instruction::GREATER:
@@ -69,14 +84,30 @@ static std::ostream &operator<<(std::ostream &out,
     return out << "STORE_LOCAL";
   case Instruction::LOAD_LOCAL:
     return out << "LOAD_LOCAL";
+  case Instruction::ADD_LOCAL_CONST:
+    return out << "ADD_LOCAL_CONST";
+  case Instruction::INC_LOCAL:
+    return out << "INC_LOCAL";
+  case Instruction::SUB_LOCAL_CONST:
+    return out << "SUB_LOCAL_CONST";
+  case Instruction::DEC_LOCAL:
+    return out << "DEC_LOCAL";
   case Instruction::JUMP:
     return out << "JUMP";
   case Instruction::JUMP_IF:
     return out << "JUMP_IF";
   case Instruction::JUMP_IFNOT:
     return out << "JUMP_IFNOT";
+  case Instruction::TABLE_SWITCH:
+    return out << "TABLE_SWITCH";
+  case Instruction::LOOKUP_SWITCH:
+    return out << "LOOKUP_SWITCH";
+  case Instruction::HASH_SWITCH:
+    return out << "HASH_SWITCH";
   case Instruction::CALL_FUNC:
     return out << "CALL_FUNC";
+  case Instruction::CALL_DIRECT:
+    return out << "CALL_DIRECT";
   case Instruction::RET:
     return out << "RET";
   case Instruction::PUT_SELF:
@@ -91,6 +122,41 @@ static std::ostream &operator<<(std::ostream &out,
     return out << "LOAD_OBJ_FIELD";
   case Instruction::IMPORT:
     return out << "IMPORT";
+  case Instruction::RAISE:
+    return out << "RAISE";
+  }
+}
+
+// number of operand codes following the instruction
+static int operand_count(const Instruction instruction) {
+  switch (instruction) {
+  case Instruction::PUT_ENV:
+  case Instruction::PUT_INT:
+  case Instruction::PUT_BOOL:
+  case Instruction::PUT_STRING:
+  case Instruction::PUT_LAMBDA:
+  case Instruction::PUT_OBJECT:
+  case Instruction::STORE_LOCAL:
+  case Instruction::LOAD_LOCAL:
+  case Instruction::JUMP:
+  case Instruction::JUMP_IF:
+  case Instruction::JUMP_IFNOT:
+  case Instruction::TABLE_SWITCH:
+  case Instruction::LOOKUP_SWITCH:
+  case Instruction::HASH_SWITCH:
+  case Instruction::LOAD_OBJ_FIELD:
+    return 1;
+  case Instruction::ADD_LOCAL_CONST:
+  case Instruction::INC_LOCAL:
+  case Instruction::SUB_LOCAL_CONST:
+  case Instruction::DEC_LOCAL:
+  case Instruction::CALL_FUNC:
+  case Instruction::CALL_DIRECT:
+  case Instruction::DEF_FUNC:
+  case Instruction::LOAD_CLASS:
+    return 2;
+  default:
+    return 0;
   }
 }
 } // namespace holang
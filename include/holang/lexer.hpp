@@ -2,18 +2,21 @@
 
 #include "holang/token.hpp"
 #include <cstddef>
-#include <map>
-#include <vector>
 
 namespace holang {
 class Lexer {
 public:
-  Lexer() { init_keywords(); }
-  Lexer(const std::string &str) : code_str(str) { init_keywords(); }
-  void lex(std::vector<Token *> &token_chain);
+  // text has to be followed by SourceFile::padding NUL bytes
+  Lexer(const char *text, size_t size) : code(text), code_size(size) {
+    init_keywords();
+  }
+  // the next token; EOF again once the text is used up
+  Token next();
+  // all tokens up to EOF
+  void lex(TokenBuffer &tokens);
 
 private:
-  Token *take_token();
+  TokenType take_token();
 
   char readc();
   void unreadc();
@@ -21,24 +24,73 @@ private:
 
   bool is_next(char c);
 
-  Token *read_number(char c);
-  Token *read_ident(char c);
-  Token *read_str();
+  TokenType read_number();
+  TokenType read_ident();
+  TokenType read_str();
 
   void skip_blank();
   void skip_to_newline();
   void skip_blank_lines();
 
-  void invalid(char c) const;
+  [[noreturn]] void invalid(char c) const;
 
 private:
-  static std::map<std::string, TokenType> keywords;
+  struct Keyword {
+    const char *word;
+    size_t length;
+    TokenType type;
+  };
+  static const size_t keyword_slots = 32;
+  static const size_t min_keyword = 2;
+  static const size_t max_keyword = 6;
+  static Keyword keywords[keyword_slots];
   static void init_keywords();
+  static size_t keyword_hash(const char *word, size_t length);
+  static TokenType keyword_or_ident(const char *word, size_t length);
 
-  std::string code_str;
+  const char *code;
+  size_t code_size;
   size_t head = 0;
-  size_t line = 0;
+  size_t line = 1;
   size_t line_begin_at = 0;
   size_t token_begin_at = 0;
 };
+
+// Tokens pulled from a lexer as the parser asks for them. Only a window of
+// the latest ones is kept, as far as lookahead and ungetting reach, so token
+// memory does not grow with the file.
+class TokenStream {
+public:
+  // the grammar needs one token of lookahead and two of ungetting
+  static const size_t max_lookahead = 3;
+  static const size_t max_unget = 4;
+
+  explicit TokenStream(Lexer &lexer) : lexer(lexer) {}
+
+  // the token ahead tokens past the next one, up to max_lookahead
+  const Token &peek(size_t ahead = 0) {
+    while (lexed <= head + ahead) {
+      window[lexed++ % window_size] = lexer.next();
+    }
+    return window[(head + ahead) % window_size];
+  }
+  Token get() {
+    Token token = peek();
+    head++;
+    return token;
+  }
+  // up to max_unget times in a row
+  void unget() { head--; }
+
+  size_t count() const { return lexed; }
+  size_t memory_bytes() const { return sizeof(window); }
+
+private:
+  static const size_t window_size = max_lookahead + 1 + max_unget;
+
+  Lexer &lexer;
+  Token window[window_size];
+  size_t head = 0;  // the next token to get
+  size_t lexed = 0; // tokens pulled from the lexer
+};
 } // namespace holang
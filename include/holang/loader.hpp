@@ -0,0 +1,125 @@
+#pragma once
+
+#include "holang/arena.hpp"
+#include "holang/bundle.hpp"
+#include "holang/bytecode.hpp"
+#include "holang/node.hpp"
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace holang {
+// The syntax tree of a module, made in its own arena, or its code from the
+// bytecode cache.
+struct ParsedModule {
+  Arena arena;
+  Node *root = nullptr; // null for an empty module
+  int local_size = 0;
+  std::vector<std::string> imports; // string literal targets, unresolved
+  std::shared_ptr<Bytecode> bytecode; // the source is then not parsed
+  uint64_t source_hash = 0;
+  size_t source_size = 0;
+};
+
+// Parses modules before the imports that run them. The string literal
+// targets of a program's imports are parsed on a pool of threads, then the
+// modules those import, and so on. Code generation allocates on the heap,
+// which is not shared between threads, so it is left to IMPORT.
+class ModuleLoader {
+public:
+  // the one IMPORT takes from
+  static ModuleLoader &get() {
+    static ModuleLoader loader;
+    return loader;
+  }
+  ModuleLoader() {}
+  ~ModuleLoader();
+  ModuleLoader(const ModuleLoader &) = delete;
+  ModuleLoader &operator=(const ModuleLoader &) = delete;
+
+  // the file IMPORT loads for target: a target starting with '.' is a path
+  // of its own, others are looked up in the search path. The path found is
+  // canonical, so a file is one module however it is named, and is
+  // remembered for the next import of target.
+  static std::string resolve(const std::string &target);
+  // path with symbolic links and dot entries resolved, itself when there is
+  // no such file
+  static std::string canonical(const std::string &path);
+  // reads and parses the module at path on this thread, unless its code is
+  // cached and cached is set; null when it can not be read, throws
+  // SyntaxError
+  static std::unique_ptr<ParsedModule> parse(const std::string &path,
+                                             bool cached = true);
+  // Appends the code of module to codes, ended by RET, and saves it to the
+  // bytecode cache; functions not called yet keep the tree. Cached code that
+  // turns out broken is dropped, and the source at the path of codes
+  // compiled instead. The heap has to be paused until codes is a root.
+  static void compile(std::unique_ptr<ParsedModule> module,
+                      CodeSequence &codes);
+
+  // Before the first import: the targets bundle was made with are resolved
+  // to its modules, which are then not read from the filesystem.
+  static void set_bundle(std::shared_ptr<const Bundle> bundle) {
+    bundled() = std::move(bundle);
+  }
+
+  // before the first preload; by default one fewer than the cores, up to 8
+  void set_workers(unsigned n) {
+    n_workers = n;
+    workers_set = true;
+  }
+
+  // queues the modules at targets not seen before
+  void preload(const std::vector<std::string> &targets);
+  // Parses the modules at paths on this thread for the first take of each,
+  // before a server forks: loader threads would not be forked with it.
+  void prepare(const std::vector<std::string> &paths);
+  // The module preloaded from path, waited for while it is parsed. Each is
+  // handed out once. Null when it was not preloaded, not started yet, taken
+  // before or did not parse: the importer then parses it itself, and
+  // reports any error where it always has.
+  std::unique_ptr<ParsedModule> take(const std::string &path);
+
+  // Modules run so far by resolved path, with their code. They are added
+  // before they run, so an import cycle ends at the module that started it.
+  // Only the thread running the program uses them.
+  bool is_loaded(const std::string &path) const {
+    return loaded.count(path) != 0;
+  }
+  void add_loaded(const std::string &path, const CodeSequence *codes) {
+    loaded.emplace(path, codes);
+  }
+
+private:
+  void enqueue(const std::string &path); // with mutex held
+  void work();
+  static unsigned default_workers();
+  static std::shared_ptr<const Bundle> &bundled();
+
+private:
+  enum class State { queued, parsing, done };
+  struct Entry {
+    State state = State::queued;
+    std::unique_ptr<ParsedModule> module;
+  };
+
+  std::mutex mutex;
+  std::condition_variable queued; // a path was queued or the loader stops
+  std::condition_variable parsed; // an entry is done
+  std::deque<std::string> queue;
+  std::unordered_map<std::string, Entry> modules; // by resolved path
+  std::vector<std::thread> workers; // started by the first preload
+  std::unordered_map<std::string, const CodeSequence *> loaded;
+  unsigned n_workers = 0;
+  bool workers_set = false;
+  bool stopping = false;
+
+  static const unsigned max_workers = 8;
+  static const std::vector<std::string> search_path;
+};
+} // namespace holang
@@ -4,6 +4,7 @@
 #include "holang/instruction.hpp"
 #include "holang/object.hpp"
 #include "holang/token.hpp"
+#include <memory>
 #include <vector>
 
 namespace holang {
@@ -12,13 +13,41 @@ struct Node {
   virtual void code_gen(CodeSequence *codes) = 0;
 };
 
+struct FuncDefNode;
+
 using namespace std;
 
+// Code generated while a LazyScope is open leaves the bodies of functions
+// and blocks for their first call. They hold on to tree, the owner of the
+// syntax tree, until then. Without a scope bodies are generated at once.
+class LazyScope {
+public:
+  explicit LazyScope(shared_ptr<const void> tree) : outer(move(current)) {
+    current = move(tree);
+  }
+  ~LazyScope() { current = move(outer); }
+  static const shared_ptr<const void> &tree() { return current; }
+
+private:
+  shared_ptr<const void> outer;
+  static shared_ptr<const void> current;
+};
+
+// code for suite, null when it is empty; its value is then 0
+void gen_suite(Node *suite, CodeSequence *codes);
+
+// sets the body of func, a function or block, to the code for body
+void gen_func_body(Func *func, Node *body, int local_size,
+                   const vector<FuncDefNode *> &callees,
+                   const string &source_path);
+
 static void exit_by_unsupported(const string &func) {
   cerr << func << " are not supported yet." << endl;
   exit(1);
 }
 
+Instruction to_opcode(TokenType c);
+
 static void print_offset(int offset) {
   for (int i = 0; i < offset; i++) {
     cout << ".  ";
@@ -30,6 +59,7 @@ public:
   IntLiteralNode(int value) : value(value){};
   void print(int offset) override;
   void code_gen(CodeSequence *codes) override;
+  int get_value() const { return value; }
 
 private:
   const int value;
@@ -50,6 +80,7 @@ public:
   StringLiteralNode(const string &str) : str(str){};
   void print(int offset) override;
   void code_gen(CodeSequence *codes) override;
+  const string &get_value() const { return str; }
 
 private:
   std::string str; // want to be const
@@ -71,14 +102,18 @@ public:
 
 struct LambdaNode : public Node {
 public:
-  LambdaNode(const vector<string *> &params, Node *body)
-      : params(params), body(body) {}
+  LambdaNode(const vector<const string *> &params, Node *body, int local_size,
+             const vector<FuncDefNode *> &callees)
+      : params(params), body(body), local_size(local_size), callees(callees) {
+  }
   void print(int offset) override;
   void code_gen(CodeSequence *codes) override;
 
 private:
-  vector<string *> params;
+  vector<const string *> params;
   Node *body;
+  int local_size;
+  vector<FuncDefNode *> callees;
 };
 
 struct BinopNode : public Node {
@@ -103,6 +138,34 @@ private:
   Node *rhs;
 };
 
+// x += rhs, x -= rhs, x *= rhs, x /= rhs
+struct CompoundAssignNode : public Node {
+public:
+  CompoundAssignNode(TokenType op, IdentNode *ident, Node *rhs)
+      : op(op), lhs(ident), rhs(rhs) {}
+  void print(int offset) override;
+  void code_gen(CodeSequence *codes) override;
+
+private:
+  TokenType op; // binary operator applied to the old value
+  IdentNode *lhs;
+  Node *rhs;
+};
+
+// ++x, --x, x++, x--
+struct IncrementNode : public Node {
+public:
+  IncrementNode(IdentNode *ident, int amount, bool is_prefix)
+      : ident(ident), amount(amount), is_prefix(is_prefix) {}
+  void print(int offset) override;
+  void code_gen(CodeSequence *codes) override;
+
+private:
+  IdentNode *ident;
+  int amount;
+  bool is_prefix; // the new value is the result instead of the old one
+};
+
 struct ExprsNode : public Node {
 public:
   ExprsNode(Node *current, Node *next, int) : current(current), next(next) {}
@@ -136,6 +199,25 @@ private:
   Node *cond, *then, *els;
 };
 
+struct CaseNode : public Node {
+public:
+  struct When {
+    vector<int> ints;
+    vector<string> strings;
+    Node *body;
+  };
+
+  CaseNode(Node *subject, const vector<When> &whens, Node *els)
+      : subject(subject), whens(whens), els(els) {}
+  void print(int offset) override;
+  void code_gen(CodeSequence *codes) override;
+
+private:
+  Node *subject;
+  vector<When> whens;
+  Node *els;
+};
+
 struct WhileNode : public Node {
 public:
   WhileNode(Node *cond, Node *body) : cond(cond), body(body) {}
@@ -148,8 +230,9 @@ private:
 
 struct FuncCallNode : public Node {
 public:
-  FuncCallNode(const string &name, const vector<Node *> &args, bool is_trailer)
-      : name(name), args(args), is_trailer(is_trailer) {}
+  FuncCallNode(const string &name, const vector<Node *> &args, bool is_trailer,
+               FuncDefNode *callee = nullptr)
+      : name(name), args(args), is_trailer(is_trailer), callee(callee) {}
   void print(int offset) override;
   void code_gen(CodeSequence *codes) override;
 
@@ -158,29 +241,44 @@ private:
   const vector<Node *> args;
   Node *block;
   bool is_trailer;
+  FuncDefNode *callee; // sealed method of self, called without lookup
 };
 
 struct FuncDefNode : public Node {
 public:
-  FuncDefNode(const string &name, const vector<string *> &params, Node *body)
-      : name(name), params(params), body(body) {}
+  FuncDefNode(const string &name, const vector<const string *> &params,
+              bool is_sealed)
+      : name(name), params(params), is_sealed(is_sealed) {}
   void print(int offset) override;
   void code_gen(CodeSequence *codes) override;
+  void set_body(Node *body, int local_size,
+                const vector<FuncDefNode *> &callees) {
+    this->body = body;
+    this->local_size = local_size;
+    this->callees = callees;
+  }
+  Func *get_func();
 
 private:
   string name;
-  vector<string *> params;
-  Node *body;
+  vector<const string *> params;
+  bool is_sealed;
+  Node *body = nullptr;
+  int local_size = 0;
+  vector<FuncDefNode *> callees; // sealed, called directly from body
+  Func *func = nullptr;
 };
 
 struct KlassDefNode : public Node {
 public:
-  KlassDefNode(const string &name, Node *body) : name(name), body(body) {}
+  KlassDefNode(const string &name, const string &superclass, Node *body)
+      : name(name), superclass(superclass), body(body) {}
   void print(int offset) override;
   void code_gen(CodeSequence *codes) override;
 
 private:
   string name;
+  string superclass; // empty without one
   Node *body;
 };
 
@@ -225,6 +323,30 @@ private:
   Node *module;
 };
 
+struct TryNode : public Node {
+public:
+  TryNode(Node *body, IdentNode *ident, Node *handler, int env)
+      : body(body), ident(ident), handler(handler), env(env) {}
+  void print(int offset) override;
+  void code_gen(CodeSequence *codes) override;
+
+private:
+  Node *body;
+  IdentNode *ident;
+  Node *handler;
+  int env;
+};
+
+struct RaiseNode : public Node {
+public:
+  RaiseNode(Node *expr) : expr(expr) {}
+  void print(int offset) override;
+  void code_gen(CodeSequence *codes) override;
+
+private:
+  Node *expr;
+};
+
 struct ReturnNode : public Node {
 public:
   ReturnNode(Node *expr) : expr(expr) {}
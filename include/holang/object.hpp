@@ -1,36 +1,72 @@
 #pragma once
 
 #include "holang/code.hpp"
+#include "holang/selector.hpp"
+#include <functional>
 #include <iostream>
 #include <map>
+#include <memory>
 #include <string>
 #include <vector>
 
 namespace holang {
+class Heap;
 class Klass;
 struct Func;
 struct Value;
 
 class Object {
 public:
-  Klass *klass;
-  std::map<std::string, Func *> methods;
+  using MethodTable = std::map<Selector, Func *>;
+
+  Klass *klass = nullptr;
+  // singleton methods, made on the first set_method; only classes and
+  // main_obj usually have them
+  MethodTable *methods = nullptr;
   std::map<std::string, Object *> fields;
+  Object *forward = nullptr; // old copy of a promoted young object
+  unsigned gc_mark = 0;
+  bool remembered = false; // in the remembered set of the heap
 
 public:
-  Func *find_method(const std::string &method_name);
+  Object() {}
+  Object(const Object &) = delete;
+  Object(Object &&obj)
+      : klass(obj.klass), methods(obj.methods), fields(std::move(obj.fields)),
+        gc_mark(obj.gc_mark), remembered(obj.remembered) {
+    obj.methods = nullptr;
+  }
+  virtual ~Object() { delete methods; }
+  // old cells come from the slabs of the heap
+  static void *operator new(size_t size);
+  static void operator delete(void *cell, size_t size);
+  Func *find_method(Selector sel);
+  virtual Func *lookup_method(Selector sel);
+  virtual void set_method(Selector sel, Func *func);
   void set_method(const std::string &name, Func *func) {
-    methods.emplace(name, func);
+    set_method(Selectors::of(name), func);
   }
   Object *find_field(const std::string &filed_bame);
-  void set_field(const std::string &name, Object *obj) {
-    fields.emplace(name, obj);
-  }
+  void set_field(const std::string &name, Object *obj);
   virtual const std::string to_s() { return "<Object>"; }
+  virtual size_t heap_size() const { return sizeof(Object); }
+  // marks the cells a subclass refers to besides methods and fields
+  virtual void trace(Heap &) {}
+  // move a young object to the old space
+  virtual Object *promote() { return new Object(std::move(*this)); }
 };
 
+// A class keeps the methods defined in its body in methods, and a table of
+// every method it responds to by selector, its ancestors' included. The
+// table is rebuilt on the first lookup after a definition in the class or
+// any ancestor, so dispatch does not depend on the depth of the hierarchy.
 class Klass : public Object {
   std::string name;
+  Klass *super = nullptr;
+  // referred strongly both ways, a hierarchy is collected as a whole
+  std::vector<Klass *> subclasses;
+  std::vector<Func *> table;
+  bool table_valid = false;
 
 public:
   Klass(std::string name) : name(name) { init(); }
@@ -38,13 +74,29 @@ public:
   static Klass Int;
   static Klass String;
   virtual const std::string to_s() { return "<" + name + ">"; }
+  virtual size_t heap_size() const { return sizeof(Klass); }
+  void trace(Heap &heap) override;
 
-  Object *new_object() {
-    auto *obj = new Object();
-    obj->klass = this;
-    return obj;
+  Klass *superclass() const { return super; }
+  void set_superclass(Klass *klass);
+  Func *dispatch(Selector sel) {
+    if (!table_valid) {
+      flatten();
+    }
+    return sel < table.size() ? table[sel] : nullptr;
   }
+  Func *lookup_method(Selector sel) override { return dispatch(sel); }
+  using Object::set_method;
+  void set_method(Selector sel, Func *func) override;
+  // a subclass at any depth defines sel in its own body
+  bool overridden_below(Selector sel) const;
+
+  Object *new_object();
   void init();
+
+private:
+  void flatten();
+  void invalidate();
 };
 
 enum FuncType {
@@ -54,15 +106,41 @@ enum FuncType {
 
 using NativeFunc = std::function<Value(Value *, Value *, int)>;
 
+// The body of a function compiled on its first call.
+struct LazyBody {
+  virtual ~LazyBody() {}
+  virtual std::shared_ptr<const CodeSequence> compile() = 0;
+  // functions the body will refer to
+  virtual void trace(Heap &) {}
+};
+
 struct Func {
   FuncType type;
   NativeFunc native;
-  CodeSequence body;
+  // finished code, shared with every copy; null for builtins, while a
+  // function definition is compiled and until a lazy one is first called
+  std::shared_ptr<const CodeSequence> body;
+  std::shared_ptr<LazyBody> lazy; // null once compiled
+  bool sealed = false;
+  unsigned gc_mark = 0;
 
-  // Func() {}
   Func(const Func &func)
-      : type(func.type), native(func.native), body(func.body) {}
+      : type(func.type), native(func.native), body(func.body),
+        lazy(func.lazy), sealed(func.sealed) {}
+  Func() : type(FUSERDEF) {} // compiled later
   Func(NativeFunc native) : type(FBUILTIN), native(native) {}
-  Func(const CodeSequence &body) : type(FUSERDEF), body(body) {}
+  Func(std::shared_ptr<const CodeSequence> body)
+      : type(FUSERDEF), body(std::move(body)) {}
+  static void *operator new(size_t size);
+  static void operator delete(void *cell, size_t size);
+
+  // the code of a user defined function, compiled on the first call
+  const CodeSequence *code() {
+    if (lazy != nullptr) {
+      compile();
+    }
+    return body.get();
+  }
+  void compile();
 };
 } // namespace holang
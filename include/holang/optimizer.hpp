@@ -0,0 +1,53 @@
+#pragma once
+
+#include "holang/code.hpp"
+#include <set>
+#include <utility>
+#include <vector>
+
+namespace holang {
+class LoopOptimizer {
+public:
+  LoopOptimizer(CodeSequence *codes) : codes(codes) {}
+  void optimize();
+
+private:
+  struct Insn {
+    Instruction op;
+    Code operand[2];
+    int target = -1; // index of the destination insn for jumps
+    bool visited = false;
+    bool dead = false;
+  };
+  using Span = std::pair<int, int>; // [first, last] insn of an expression
+
+  void decode();
+  void encode();
+  void compact();
+
+  void fold_constants();
+  void reduce_strength();
+  void fuse_induction();
+  void discard_results();
+  void share_local_strings();
+  void move_invariants();
+  void move_invariants(int back_edge);
+  void find_invariants(int begin, int end, std::vector<Span> *spans);
+
+  void emit_region(int begin, int end, const std::vector<Span> &spans,
+                   const std::vector<int> &temps, std::vector<Insn> *out,
+                   std::vector<int> *index_of) const;
+
+  bool is_invariant_leaf(const Insn &insn) const;
+  bool is_loop_safe(int head, int test, int back_edge) const;
+  bool is_straight(int begin, int n) const;
+
+private:
+  CodeSequence *codes;
+  std::vector<Insn> insns;
+  std::vector<CodeSequence::Handler> handlers; // in insn indices
+  std::vector<CodeSequence::Switch> switches;  // in insn indices
+  std::vector<bool> targeted;
+  std::set<int> written; // locals stored in the current loop
+};
+} // namespace holang
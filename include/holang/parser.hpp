@@ -1,44 +1,53 @@
 #pragma once
 
+#include "holang/arena.hpp"
+#include "holang/exception.hpp"
 #include "holang/node.hpp"
+#include "holang/lexer.hpp"
 #include "holang/token.hpp"
 #include "holang/variable_table.hpp"
+#include <climits>
 #include <iostream>
+#include <map>
+#include <sstream>
 #include <vector>
 
 namespace holang {
 class Parser {
 public:
-  Parser(const std::vector<Token *> &token_chain) : token_chain(token_chain) {}
+  // nodes are made in arena, which has to outlive code generation
+  Parser(TokenStream &tokens, Arena &arena) : tokens(tokens), arena(arena) {}
   Node *parse();
   int toplevel_val_size() { return variable_table.size(); }
+  // targets of the imports parsed that are string literals
+  const std::vector<std::string> &imports() const { return imported; }
 
 private:
-  Token *get() { return token_chain[head++]; }
-  Token *get_ident() {
-    Token *token = get();
-    if (token->type != TokenType::Ident) {
-      exit_by_unexpected(TokenType::Ident, token);
+  Token get() { return tokens.get(); }
+  Token get_ident() {
+    Token token = get();
+    if (token.type != TokenType::Ident) {
+      throw_unexpected(TokenType::Ident, token);
     }
     return token;
   }
-  void unget() { head--; }
+  void unget() { tokens.unget(); }
 
 private:
   void take(TokenType type);
   void consume_newlines();
 
 private:
-  bool is_next(TokenType type, int offset = 0) {
-    return token_chain[head - offset]->type == type;
+  // ahead counts the tokens skipped, see TokenStream::max_lookahead
+  bool is_next(TokenType type, size_t ahead = 0) {
+    return tokens.peek(ahead).type == type;
   }
   bool is_eof() { return is_next(TokenType::TEOF); }
   bool next_token(TokenType type) {
-    Token *token = get();
-    if (token->type == type) {
+    if (is_next(type)) {
+      get();
       return true;
     }
-    unget();
     return false;
   }
 
@@ -47,12 +56,16 @@ private:
 
   Node *read_stmt();
   Node *read_if();
+  Node *read_case();
   Node *read_funcdef();
   Node *read_klassdef();
   Node *read_import();
   Node *read_while();
   Node *read_return();
+  Node *read_try();
+  Node *read_raise();
   Node *read_suite();
+  Node *read_branch();
 
   Node *read_expr();
   Node *read_assignment_expr();
@@ -63,37 +76,53 @@ private:
   Node *read_factor();
   Node *read_prime_expr();
   Node *read_traier();
+  Node *ast_binop(TokenType op, Node *lhs, Node *rhs);
 
   Node *read_prime();
   Node *read_number();
   Node *read_string();
   Node *read_name_or_funccall(bool is_trailer);
+  IdentNode *find_ident(const Token &ident);
   Node *read_block();
   void read_exprs(std::vector<Node *> &args);
   void read_arglist(std::vector<Node *> *args);
-  void read_params(std::vector<std::string *> *params);
+  void read_params(std::vector<const std::string *> *params);
 
 private:
-  void exit_by_unexpected(TokenType expect, Token *actual) {
-    std::cerr << "unexpected token: ";
-    std::cerr << "line " << actual->line << ", column " << actual->column
-              << std::endl;
-    std::cerr << "  expect: " << expect << std::endl;
-    std::cerr << "  actual: " << actual << std::endl;
-    exit(1);
+  // throw a SyntaxError
+  [[noreturn]] void throw_unexpected(TokenType expect, const Token &actual) {
+    std::ostringstream name;
+    name << expect;
+    throw_unexpected(name.str(), actual);
   }
-  void exit_by_unexpected(const std::string &expect, Token *actual) {
-    std::cerr << "unexpected token: ";
-    std::cerr << "line " << actual->line << ", column " << actual->column
-              << std::endl;
-    std::cerr << "  expect: " << expect << std::endl;
-    std::cerr << "  actual: " << actual << std::endl;
-    exit(1);
+  [[noreturn]] void throw_unexpected(const std::string &expect,
+                                     const Token &actual) {
+    std::ostringstream report;
+    report << "unexpected token: ";
+    report << "line " << actual.line << ", column " << actual.column
+           << std::endl;
+    report << "  expect: " << expect << std::endl;
+    report << "  actual: ";
+    actual.print(report);
+    throw SyntaxError(report.str());
+  }
+  // the value of an integer literal, a SyntaxError when it is over max
+  int64_t read_integer(const Token &token, int64_t max = INT_MAX) {
+    if (token.integer() > (uint64_t)max) {
+      throw_unexpected("integer up to " + std::to_string(max), token);
+    }
+    return token.integer();
   }
 
 private:
-  const std::vector<Token *> token_chain;
+  TokenStream &tokens;
+  Arena &arena;
   VariableTable variable_table;
-  int head = 0;
+  // sealed methods of the current self, bound at compile time
+  std::map<std::string, FuncDefNode *> sealed_funcs;
+  int class_depth = 0; // class bodies open in the current code sequence
+  // sealed functions the innermost function or block calls directly
+  std::vector<FuncDefNode *> *callees = nullptr;
+  std::vector<std::string> imported;
 };
 } // namespace holang
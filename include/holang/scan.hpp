@@ -0,0 +1,54 @@
+#pragma once
+
+#include <string>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace holang {
+// Scanners for the runs of bytes the lexer skips over. Each returns the first
+// position at or after p that ends its run. A NUL ends every run, and the
+// text has to be followed by SourceFile::padding NUL bytes: the vector
+// versions read 16 or 32 bytes at a time.
+namespace scan {
+// Identifiers are short, so their scanner is inlined; SSE2 is part of every
+// x86-64. Bytes from 0x80 compare as negative and are never part of one.
+inline const char *skip_ident(const char *p) {
+#if defined(__SSE2__)
+  while (true) {
+    __m128i v = _mm_loadu_si128((const __m128i *)p);
+    // letters folded to lower case; no other byte lands in a-z that way
+    __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    __m128i letter =
+        _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                      _mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1)));
+    __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+                                  _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+    __m128i ident = _mm_or_si128(_mm_or_si128(letter, digit),
+                                 _mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+    unsigned end = ~_mm_movemask_epi8(ident) & 0xffff;
+    if (end != 0) {
+      return p + __builtin_ctz(end);
+    }
+    p += 16;
+  }
+#else
+  while (('a' <= (*p | 0x20) && (*p | 0x20) <= 'z') ||
+         ('0' <= *p && *p <= '9') || *p == '_') {
+    p++;
+  }
+  return p;
+#endif
+}
+
+// Strings and comments run long enough to pay for a call to the widest
+// version the CPU supports, AVX2 or SSE2 on x86-64, picked at startup.
+const char *find_quote(const char *p);   // up to '"'
+const char *find_newline(const char *p); // up to '\n'
+
+// "avx2", "sse2" or "scalar"
+const char *isa();
+// for benchmarks; false when name is unknown or not supported here
+bool select(const std::string &name);
+} // namespace scan
+} // namespace holang
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace holang {
+// Number of a method name, given out in the order names are first seen.
+// Calls carry it as their operand and classes index their method tables by
+// it.
+using Selector = unsigned;
+
+class Selectors {
+public:
+  static Selector of(const std::string &name) {
+    Table &table = get();
+    auto it = table.ids.emplace(name, (Selector)table.names.size()).first;
+    if (it->second == table.names.size()) {
+      table.names.push_back(&it->first);
+    }
+    return it->second;
+  }
+  static const std::string &name(Selector sel) { return *get().names[sel]; }
+
+private:
+  struct Table {
+    std::unordered_map<std::string, Selector> ids;
+    std::vector<const std::string *> names;
+  };
+  // the builtin classes define methods while statics are initialized
+  static Table &get() {
+    static Table table;
+    return table;
+  }
+};
+} // namespace holang
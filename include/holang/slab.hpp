@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace holang {
+// Size-class allocator for the cells of the old space.
+//
+// Sizes are rounded up to a multiple of 16 bytes and every class carves its
+// own cache-line aligned slabs into cells of that size. Freed cells are kept
+// on a free list per class and reused first; slabs are never returned. Larger
+// cells come from operator new.
+class SlabAllocator {
+public:
+  SlabAllocator() {}
+  ~SlabAllocator();
+  SlabAllocator(const SlabAllocator &) = delete;
+  SlabAllocator &operator=(const SlabAllocator &) = delete;
+
+  void *allocate(size_t size) {
+    if (size > max_size) {
+      return ::operator new(size);
+    }
+    SizeClass &sc = classes[index_of(size)];
+    used_bytes += cell_size(size);
+    if (sc.free != nullptr) {
+      FreeCell *cell = sc.free;
+      sc.free = cell->next;
+      return cell;
+    }
+    if (sc.top == sc.end) {
+      refill(sc, cell_size(size));
+    }
+    void *cell = sc.top;
+    sc.top += cell_size(size);
+    return cell;
+  }
+
+  void free(void *cell, size_t size) {
+    if (size > max_size) {
+      ::operator delete(cell);
+      return;
+    }
+    SizeClass &sc = classes[index_of(size)];
+    used_bytes -= cell_size(size);
+    auto *free_cell = (FreeCell *)cell;
+    free_cell->next = sc.free;
+    sc.free = free_cell;
+  }
+
+  // reserved by slabs, and in cells handed out of them
+  size_t slab_bytes() const { return slabs.size() * slab_size; }
+  size_t live_bytes() const { return used_bytes; }
+
+private:
+  struct FreeCell {
+    FreeCell *next;
+  };
+  struct SizeClass {
+    FreeCell *free = nullptr;
+    char *top = nullptr; // uncarved rest of the newest slab
+    char *end = nullptr;
+  };
+
+  static size_t index_of(size_t size) {
+    return (size + granularity - 1) / granularity - 1;
+  }
+  static size_t cell_size(size_t size) {
+    return (size + granularity - 1) & ~(granularity - 1);
+  }
+  void refill(SizeClass &sc, size_t cell);
+
+private:
+  static const size_t granularity = 16;
+  static const size_t max_size = 512;
+  static const size_t slab_size = 1 << 16;
+  static const size_t cache_line = 64;
+
+  SizeClass classes[max_size / granularity];
+  std::vector<void *> slabs;
+  size_t used_bytes = 0;
+};
+} // namespace holang
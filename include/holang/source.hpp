@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace holang {
+// The text of a source file. A regular file is mapped read-only instead of
+// being copied; anything else, such as a pipe, is read into memory. Either
+// way the text is followed by at least padding NUL bytes, so a lexer can
+// read past its end without checking.
+class SourceFile {
+public:
+  static const size_t padding = 64;
+
+  explicit SourceFile(const std::string &path);
+  SourceFile(const SourceFile &) = delete;
+  SourceFile &operator=(const SourceFile &) = delete;
+  ~SourceFile();
+
+  bool fail() const { return text == nullptr; }
+  const char *data() const { return text; }
+  size_t size() const { return text_size; }
+
+private:
+  bool map(int fd, size_t size);
+  bool read_all(int fd);
+
+private:
+  const char *text = nullptr;
+  size_t text_size = 0;
+  size_t mapped = 0; // length of the mapping, 0 when read
+  std::string copy;
+};
+} // namespace holang
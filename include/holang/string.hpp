@@ -7,6 +7,8 @@ class String : public Object {
 public:
   String(const std::string &str) : str(str) { klass = &Klass::String; }
   virtual const std::string to_s() { return str; }
+  virtual size_t heap_size() const { return sizeof(String) + str.capacity(); }
+  virtual Object *promote() { return new String(std::move(*this)); }
 
   static void init();
 
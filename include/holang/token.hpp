@@ -1,9 +1,13 @@
 #pragma once
 
+#include <cstdint>
+#include <cstdio>
 #include <ostream>
+#include <string>
+#include <vector>
 
 namespace holang {
-enum class TokenType {
+enum class TokenType : uint8_t {
   // literal
   Integer,
   Double,
@@ -43,6 +47,12 @@ enum class TokenType {
   Import,
   While,
   Return,
+  Sealed,
+  Try,
+  Catch,
+  Raise,
+  Case,
+  When,
 
   // delimiter
   ParenL,     // (
@@ -59,28 +69,6 @@ enum class TokenType {
   TEOF,       // EOF is defined by stdio.h
 };
 
-struct Token {
-  TokenType type;
-  union {
-    uint64_t i;
-    double d;
-    std::string str;
-  };
-  int line;
-  int column;
-
-  Token(TokenType type) : type(type) {}
-  Token(uint64_t i) : type(TokenType::Integer), i(i) {}
-  Token(double d) : type(TokenType::Double), d(d) {}
-  Token(TokenType type, const std::string &str) : type(type), str(str) {}
-
-  ~Token() {
-    if (type == TokenType::String || type == TokenType::Ident) {
-      str.~basic_string();
-    }
-  }
-};
-
 static std::ostream &operator<<(std::ostream &out, const TokenType type) {
   switch (type) {
   // literal
@@ -156,6 +144,18 @@ static std::ostream &operator<<(std::ostream &out, const TokenType type) {
     return out << "While";
   case TokenType::Return:
     return out << "return";
+  case TokenType::Sealed:
+    return out << "Sealed";
+  case TokenType::Try:
+    return out << "Try";
+  case TokenType::Catch:
+    return out << "Catch";
+  case TokenType::Raise:
+    return out << "Raise";
+  case TokenType::Case:
+    return out << "Case";
+  case TokenType::When:
+    return out << "When";
 
   // delimitor
   case TokenType::ParenL:
@@ -185,20 +185,93 @@ static std::ostream &operator<<(std::ostream &out, const TokenType type) {
   }
 }
 
-static std::ostream &operator<<(std::ostream &out, const Token *token) {
-  char pos[15];
-  snprintf(pos, 15, "(%3d,%3d)", token->line, token->column);
-  out << pos << ' ';
-
-  if (token->type == TokenType::Integer) {
-    return out << token->type << " " << token->i;
-  } else if (token->type == TokenType::Double) {
-    return out << token->type << " " << token->d;
-  } else if (token->type == TokenType::Ident ||
-             token->type == TokenType::String) {
-    return out << token->type << " " << token->str;
-  } else {
-    return out << token->type;
+// A token as the span of the source it was read from. Nothing is copied, so
+// the source has to outlive it.
+struct Token {
+  TokenType type;
+  uint32_t length;
+  int line;
+  int column;
+  const char *begin;
+
+  std::string text() const { return std::string(begin, length); }
+
+  // literal values; an integer too long for 64 bits is UINT64_MAX
+  uint64_t integer() const {
+    uint64_t value = 0;
+    for (const char *c = begin; c < begin + length; c++) {
+      if (value > (UINT64_MAX - 9) / 10) {
+        return UINT64_MAX;
+      }
+      value = value * 10 + (*c - '0');
+    }
+    return value;
   }
-}
+  double real() const { return std::stod(text()); }
+  std::string str() const { // without the quotes
+    return std::string(begin + 1, length - 2);
+  }
+
+  void print(std::ostream &out) const {
+    char pos[15];
+    snprintf(pos, 15, "(%3d,%3d)", line, column);
+    out << pos << ' ' << type;
+    switch (type) {
+    case TokenType::Double:
+      out << " " << real();
+      break;
+    case TokenType::Integer: // as written, it may not fit
+    case TokenType::Ident:
+      out << " " << text();
+      break;
+    case TokenType::String:
+      out << " " << str();
+      break;
+    default:
+      break;
+    }
+  }
+};
+
+// All tokens of one source text as parallel arrays, a token being stored as
+// its offset into the source.
+class TokenBuffer {
+public:
+  explicit TokenBuffer(const char *source) : source(source) {}
+
+  void push(const Token &token) {
+    types.push_back(token.type);
+    offsets.push_back(token.begin - source);
+    lengths.push_back(token.length);
+    lines.push_back(token.line);
+    columns.push_back(token.column);
+  }
+
+  void reserve(size_t n) {
+    types.reserve(n);
+    offsets.reserve(n);
+    lengths.reserve(n);
+    lines.reserve(n);
+    columns.reserve(n);
+  }
+  size_t size() const { return types.size(); }
+  Token operator[](size_t i) const {
+    return Token{types[i], lengths[i], (int)lines[i], (int)columns[i],
+                 source + offsets[i]};
+  }
+
+  // of the tokens pushed; space reserved past them is never touched and
+  // costs address space only
+  size_t memory_bytes() const {
+    return size() * (sizeof(TokenType) + 4 * sizeof(uint32_t));
+  }
+
+private:
+  const char *source;
+  std::vector<TokenType> types;
+  std::vector<uint32_t> offsets;
+  std::vector<uint32_t> lengths;
+  std::vector<uint32_t> lines;
+  std::vector<uint32_t> columns;
+};
 } // namespace holang
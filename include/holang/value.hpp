@@ -31,7 +31,7 @@ struct Value {
   Value(Func *func) : type(Type::FUNCTION), funcval(func) {}
   Value(Object *obj) : type(Type::OBJECT), objval(obj) {}
 
-  Func *find_method(const std::string &name);
+  Func *find_method(Selector sel);
   Object *find_field(const std::string &name);
 
   const std::string to_s() {
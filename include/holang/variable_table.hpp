@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithm>
 #include <string>
 #include <vector>
 
@@ -30,7 +31,7 @@ private:
     int size() { return vec.size(); }
 
   private:
-    std::vector<const std::string> vec;
+    std::vector<std::string> vec;
     Table *prev;
   };
 
@@ -56,6 +57,12 @@ public:
       return make_pair(0, pos);
     }
   }
+  // index of ident in the innermost scope, added when only an outer one has
+  // it
+  int insert_local(const std::string &ident) {
+    auto res = find(ident);
+    return res.first == 0 ? res.second : current->insert(ident);
+  }
   void next() { current = new Table(current); }
   void prev() {
     Table *trash = current;
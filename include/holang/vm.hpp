@@ -1,12 +1,14 @@
 #pragma once
 
 #include "holang.hpp"
-#include "holang/lexer.hpp"
-#include "holang/parser.hpp"
+#include "holang/exception.hpp"
+#include "holang/heap.hpp"
+#include "holang/loader.hpp"
 #include "holang/string.hpp"
 
+#include <algorithm>
+#include <climits>
 #include <cstring>
-#include <fstream>
 #include <iostream>
 #include <limits>
 
@@ -44,7 +46,7 @@ static Value println_func(Value *, Value *args, int argc) {
 static Value getline_func(Value *, Value *, int) {
   std::string str;
   cin >> str;
-  return Value((Object *)new String(str));
+  return Value((Object *)Heap::get().make<String>(str));
 }
 
 static Value next_func(Value *self, Value *, int) {
@@ -56,15 +58,11 @@ void call_func_argc_one(Value *self, Func *func, Value *arg);
 
 static Value times_func(Value *self, Value *args, int argc) {
   if (argc != 1) {
-    std::cerr << "invalid argc" << std::endl;
-    exit(1);
+    raise_error("invalid argc: " + std::to_string(argc));
   }
 
   if (args[0].type != Type::FUNCTION) {
-    std::cerr << "have to func" << std::endl;
-    std::cerr << argc << std::endl;
-    std::cerr << args[0].to_s() << std::endl;
-    exit(1);
+    raise_error("have to func: " + args[0].to_s());
   }
 
   Func *func = args[0].funcval;
@@ -76,29 +74,37 @@ static Value times_func(Value *self, Value *args, int argc) {
 }
 
 class HolangVM {
-  using Codes = CodeSequence;
+  using Codes = const CodeSequence;
 
 public:
   HolangVM(int local_val_size) {
+    Heap::get().add_vm(this);
     init_main_obj();
-    init_import_search_path();
     if (stack == nullptr)
       stack = new Value[stack_size];
     stack_push(HolangVM::main_obj);
-    sp += local_val_size;
+    for (int i = 1; i < local_val_size; i++) {
+      stack_push(0);
+    }
   }
 
-  HolangVM(Value *args, int local_val_size) {
+  HolangVM(Value *args, int argc, int local_val_size) {
+    Heap::get().add_vm(this);
     init_main_obj();
     if (stack == nullptr)
       stack = new Value[stack_size];
     stack_push(HolangVM::main_obj);
-    for (int i = 0; i < local_val_size; i++) {
+    for (int i = 0; i < argc; i++) {
       stack_push(args[i]);
     }
+    for (int i = argc + 1; i < local_val_size; i++) {
+      stack_push(0);
+    }
   }
 
   ~HolangVM() {
+    Heap::get().remove_vm(this);
+    Heap::get().release_stack(stack_bytes);
     if (stack != nullptr)
       delete[] stack;
   }
@@ -107,17 +113,18 @@ public:
     if (main_obj != nullptr) {
       return;
     }
-    main_obj = new Object();
+    Heap &heap = Heap::get();
+    main_obj = heap.make<Object>();
     NativeFunc native = print_func;
-    main_obj->set_method("print", new Func(native));
+    main_obj->set_method("print", heap.make<Func>(native));
     NativeFunc native_println = println_func;
-    main_obj->set_method("println", new Func(native_println));
+    main_obj->set_method("println", heap.make<Func>(native_println));
     NativeFunc native_getline = getline_func;
-    main_obj->set_method("getline", new Func(native_getline));
+    main_obj->set_method("getline", heap.make<Func>(native_getline));
 
     NativeFunc next_native = next_func;
-    Klass::Int.set_method("next", new Func(next_native));
-    Klass::Int.set_method("times", new Func(times_func));
+    Klass::Int.set_method("next", heap.make<Func>(next_native));
+    Klass::Int.set_method("times", heap.make<Func>(times_func));
     String::init();
 
     main_obj->set_field("Int", &Klass::Int);
@@ -125,6 +132,61 @@ public:
   }
 
   void eval() {
+    while (true) {
+      try {
+        run();
+        return;
+      } catch (const RaiseException &e) {
+        if (!unwind(e.value)) {
+          throw;
+        }
+      }
+    }
+  }
+
+  // Limits on a run of the embedder, shared by the VMs that natives start
+  // for blocks. A step is a call or a backward jump; 0 means no limit.
+  // Running out throws LimitExceeded.
+  static void set_step_limit(uint64_t steps);
+  // milliseconds of wall-clock time from now
+  static void set_time_limit(double ms);
+
+  void mark_roots(Heap &heap) {
+    for (int i = 0; i < sp; i++) {
+      heap.mark(stack[i]);
+    }
+    heap.mark(main_obj);
+    if (codes != nullptr) {
+      heap.mark(*codes);
+    }
+    for (const auto &frame : prev_code) {
+      heap.mark(*frame.first);
+    }
+  }
+
+  void forward_roots(Heap &heap) {
+    for (int i = 0; i < sp; i++) {
+      heap.forward(stack[i]);
+    }
+    heap.forward(main_obj);
+  }
+
+  void print_stack() {
+    std::cout << "--- print stack ---" << std::endl;
+    printf("%2d:\t\t<- sp\n", sp);
+    for (int i = sp - 1; i >= 0; i--) {
+      printf("%2d: ", i);
+      std::cout << stack[i].to_s();
+      if (i == ep) {
+        std::cout << "\t<- ep";
+      }
+      std::cout << std::endl;
+    }
+    std::cout << "-------------------" << std::endl;
+  }
+
+private:
+  void run() {
     while (pc < codes->size()) {
       auto op = take_code().op;
       switch (op) {
@@ -143,6 +205,9 @@ public:
       case Instruction::MOD:
         binop_mod();
         break;
+      case Instruction::SHL:
+        binop_shl();
+        break;
       case Instruction::LESS:
         binop_less();
         break;
@@ -167,18 +232,36 @@ public:
       case Instruction::PUT_LAMBDA:
         put_lambda();
         break;
+      case Instruction::PUT_OBJECT:
+        put_object();
+        break;
       case Instruction::LOAD_LOCAL:
         load_local();
         break;
       case Instruction::STORE_LOCAL:
         store_local();
         break;
+      case Instruction::ADD_LOCAL_CONST:
+        add_local_const();
+        break;
+      case Instruction::INC_LOCAL:
+        inc_local();
+        break;
+      case Instruction::SUB_LOCAL_CONST:
+        sub_local_const();
+        break;
+      case Instruction::DEC_LOCAL:
+        dec_local();
+        break;
       case Instruction::DEF_FUNC:
         def_func();
         break;
       case Instruction::CALL_FUNC:
         call_func();
         break;
+      case Instruction::CALL_DIRECT:
+        call_direct();
+        break;
       case Instruction::RET:
         func_ret();
         break;
@@ -194,6 +277,15 @@ public:
       case Instruction::JUMP_IFNOT:
         jump_ifnot();
         break;
+      case Instruction::TABLE_SWITCH:
+        table_switch();
+        break;
+      case Instruction::LOOKUP_SWITCH:
+        lookup_switch();
+        break;
+      case Instruction::HASH_SWITCH:
+        hash_switch();
+        break;
       case Instruction::LOAD_CLASS:
         load_class();
         break;
@@ -206,6 +298,9 @@ public:
       case Instruction::IMPORT:
         import();
         break;
+      case Instruction::RAISE:
+        raise();
+        break;
       default:
         std::cerr << "not implemented: " << op << std::endl;
         exit(1);
@@ -213,21 +308,53 @@ public:
     }
   }
 
-  void print_stack() {
-    std::cout << "--- print stack ---" << std::endl;
-    printf("%2d:\t\t<- sp\n", sp);
-    for (int i = sp - 1; i >= 0; i--) {
-      printf("%2d: ", i);
-      std::cout << stack[i].to_s();
-      if (i == ep) {
-        std::cout << "\t<- ep";
+  // Find the innermost handler covering pc, leaving frames on the way.
+  // Nothing is recorded when a try statement is entered; the cost is paid
+  // here, only when something is raised.
+  bool unwind(const Value &exception) {
+    int at = pc - 1;
+    while (true) {
+      for (const auto &handler : codes->get_handlers()) {
+        if (handler.begin <= at && at < handler.end) {
+          while (open_envs() > handler.env) {
+            load_ep();
+          }
+          sp = handler.env == 0 ? ep + codes->local_size() : ep + 1;
+          stack_push(exception);
+          pc = handler.target;
+          return true;
+        }
       }
-      std::cout << std::endl;
+
+      while (open_envs() > 0) {
+        load_ep();
+      }
+      if (prev_code.empty()) {
+        return false;
+      }
+      sp = ep;
+      ep = prev_ep.back();
+      prev_ep.pop_back();
+      load_prev_codes();
+      at = pc - 1;
     }
-    std::cout << "-------------------" << std::endl;
   }
 
-private:
+  // class bodies entered in the current frame
+  int open_envs() {
+    int n = 0;
+    for (auto it = prev_class_ep.rbegin();
+         it != prev_class_ep.rend() && it->second == prev_code.size(); it++) {
+      n++;
+    }
+    return n;
+  }
+
+  [[noreturn]] void binop_error(const char *op, Value &lhs, Value &rhs) {
+    raise_error(std::string("can not cal ") + op + ": " + lhs.to_s() + ", " +
+                rhs.to_s());
+  }
+
   void binop_add() {
     auto rhs = stack_pop();
     auto lhs = stack_pop();
@@ -246,10 +373,7 @@ private:
       //   stack->push_back(Value({Type::DOUBLE, .dval = lhs.dval op
       //   rhs.dval}));
     } else {
-      std::cerr << "can not cal +" << std::endl;
-      std::cerr << rhs.to_s() << std::endl;
-      std::cerr << lhs.to_s() << std::endl;
-      exit(1);
+      binop_error("+", lhs, rhs);
     }
   }
   void binop_sub() {
@@ -270,10 +394,7 @@ private:
       //   stack->push_back(Value({Type::DOUBLE, .dval = lhs.dval op
       //   rhs.dval}));
     } else {
-      std::cerr << "can not cal -" << std::endl;
-      std::cerr << rhs.to_s() << std::endl;
-      std::cerr << lhs.to_s() << std::endl;
-      exit(1);
+      binop_error("-", lhs, rhs);
     }
   }
   void binop_mul() {
@@ -282,34 +403,49 @@ private:
     if (lhs.type == Type::INT && rhs.type == Type::INT) {
       stack_push(lhs.ival * rhs.ival);
     } else {
-      std::cerr << "can not cal *" << std::endl;
-      std::cerr << rhs.to_s() << std::endl;
-      std::cerr << lhs.to_s() << std::endl;
-      exit(1);
+      binop_error("*", lhs, rhs);
     }
   }
   void binop_div() {
     auto rhs = stack_pop();
     auto lhs = stack_pop();
     if (lhs.type == Type::INT && rhs.type == Type::INT) {
+      // both trap in the processor rather than raise
+      if (rhs.ival == 0) {
+        raise_error("divided by 0");
+      }
+      if (lhs.ival == INT_MIN && rhs.ival == -1) {
+        raise_error("integer overflow: " + lhs.to_s() + " / -1");
+      }
       stack_push(lhs.ival / rhs.ival);
     } else {
-      std::cerr << "can not cal /" << std::endl;
-      std::cerr << rhs.to_s() << std::endl;
-      std::cerr << lhs.to_s() << std::endl;
-      exit(1);
+      binop_error("/", lhs, rhs);
     }
   }
   void binop_mod() {
     auto rhs = stack_pop();
     auto lhs = stack_pop();
     if (lhs.type == Type::INT && rhs.type == Type::INT) {
-      stack_push(lhs.ival % rhs.ival);
+      if (rhs.ival == 0) {
+        raise_error("divided by 0");
+      }
+      // INT_MIN % -1 traps as INT_MIN / -1 does
+      stack_push(rhs.ival == -1 ? 0 : lhs.ival % rhs.ival);
+    } else {
+      binop_error("%", lhs, rhs);
+    }
+  }
+  void binop_shl() {
+    auto rhs = stack_pop();
+    auto lhs = stack_pop();
+    if (lhs.type == Type::INT && rhs.type == Type::INT) {
+      stack_push((int)((unsigned)lhs.ival << rhs.ival));
+    } else if (rhs.type == Type::INT && 0 < rhs.ival && rhs.ival < 31) {
+      // only made from * 2^k, which is what the script wrote
+      Value factor(1 << rhs.ival);
+      binop_error("*", lhs, factor);
     } else {
-      std::cerr << "can not cal %" << std::endl;
-      std::cerr << rhs.to_s() << std::endl;
-      std::cerr << lhs.to_s() << std::endl;
-      exit(1);
+      binop_error("<<", lhs, rhs);
     }
   }
   void binop_less() {
@@ -330,10 +466,7 @@ private:
       //   stack->push_back(Value({Type::DOUBLE, .dval = lhs.dval op
       //   rhs.dval}));
     } else {
-      std::cerr << "can not cal <" << std::endl;
-      std::cerr << rhs.to_s() << std::endl;
-      std::cerr << lhs.to_s() << std::endl;
-      exit(1);
+      binop_error("<", lhs, rhs);
     }
   }
 
@@ -343,10 +476,7 @@ private:
     if (lhs.type == Type::INT && rhs.type == Type::INT) {
       stack_push(lhs.ival > rhs.ival);
     } else {
-      std::cerr << "can not cal >" << std::endl;
-      std::cerr << rhs.to_s() << std::endl;
-      std::cerr << lhs.to_s() << std::endl;
-      exit(1);
+      binop_error(">", lhs, rhs);
     }
   }
 
@@ -356,10 +486,7 @@ private:
     if (lhs.type == Type::INT && rhs.type == Type::INT) {
       stack_push(lhs.ival == rhs.ival);
     } else {
-      std::cerr << "can not cal ==" << std::endl;
-      std::cerr << rhs.to_s() << std::endl;
-      std::cerr << lhs.to_s() << std::endl;
-      exit(1);
+      binop_error("==", lhs, rhs);
     }
   }
 
@@ -380,8 +507,8 @@ private:
   // put_string string_ptr
   // [] -> [val]
   void put_string() {
-    std::string *str = take_code().sval;
-    stack_push(new String(*str));
+    const std::string *str = take_code().sval;
+    stack_push(Heap::get().make<String>(*str));
   }
 
   // put_lambda lambda_ptr
@@ -391,6 +518,11 @@ private:
     stack_push(lambda);
   }
 
+  // put_object obj_ptr
+  // [] -> [val]
+  // an old object owned by the code, which does not let it escape
+  void put_object() { stack_push(take_code().objval); }
+
   // load_local index
   // [] -> [val]
   void load_local() {
@@ -406,22 +538,86 @@ private:
     stack[ep + offset] = v;
   }
 
-  // def_func func_name, func_obj
+  // add_local_const index, number
+  // [] -> [val]
+  void add_local_const() {
+    int offset = take_code().ival;
+    int num = take_code().ival;
+    Value &local = stack[ep + offset];
+    if (local.type != Type::INT) {
+      Value rhs(num);
+      binop_error("+", local, rhs);
+    }
+    local.ival += num;
+    stack_push(local.ival);
+  }
+
+  // inc_local index, number
+  // [] -> []
+  void inc_local() {
+    int offset = take_code().ival;
+    int num = take_code().ival;
+    Value &local = stack[ep + offset];
+    if (local.type != Type::INT) {
+      Value rhs(num);
+      binop_error("+", local, rhs);
+    }
+    local.ival += num;
+  }
+
+  // sub_local_const index, number
+  // [] -> [val]
+  void sub_local_const() {
+    int offset = take_code().ival;
+    int num = take_code().ival;
+    Value &local = stack[ep + offset];
+    if (local.type != Type::INT) {
+      Value rhs(num);
+      binop_error("-", local, rhs);
+    }
+    local.ival -= num;
+    stack_push(local.ival);
+  }
+
+  // dec_local index, number
+  // [] -> []
+  void dec_local() {
+    int offset = take_code().ival;
+    int num = take_code().ival;
+    Value &local = stack[ep + offset];
+    if (local.type != Type::INT) {
+      Value rhs(num);
+      binop_error("-", local, rhs);
+    }
+    local.ival -= num;
+  }
+
+  // def_func selector, func_obj
   // [] -> [true]
   void def_func() {
     auto *self = stack[ep].objval;
-    const std::string &name = *take_code().sval;
+    Selector sel = take_code().ival;
     Func *obj = (Func *)take_code().objval;
-    self->set_method(name, obj);
+    Func *defined = self->lookup_method(sel);
+    if (defined != nullptr && defined != obj && defined->sealed) {
+      raise_error("can not redefine sealed method: " + Selectors::name(sel));
+    }
+    // calls bound to it directly would skip the subclass's own
+    auto *klass = dynamic_cast<Klass *>(self);
+    if (obj->sealed && klass != nullptr && klass->overridden_below(sel)) {
+      raise_error("can not seal method overridden in a subclass: " +
+                  Selectors::name(sel));
+    }
+    self->set_method(sel, obj);
     stack_push(true);
   }
 
-  // call_func func_name, argc
+  // call_func selector, argc
   void call_func() {
-    std::string *func_name = take_code().sval;
+    Selector sel = take_code().ival;
     int argc = take_code().ival;
     Value *self = &stack[sp - argc - 1];
-    auto func = self->find_method(*func_name);
+    auto func = self->find_method(sel);
 
     Value ret;
     if (func->type == FBUILTIN) {
@@ -429,13 +625,29 @@ private:
       sp = sp - argc - 1;
       stack_push(ret);
     } else {
-      save_current_codes();
-      prev_ep.push_back(ep);
+      enter_func(func, argc);
+    }
+  }
+
+  // call_direct func_ptr, argc
+  // bound at compile time to a sealed method of self
+  void call_direct() {
+    Func *func = take_code().funcval;
+    int argc = take_code().ival;
+    enter_func(func, argc);
+  }
 
-      codes = &func->body;
-      pc = 0;
-      ep = sp - argc - 1;
+  void enter_func(Func *func, int argc) {
+    save_current_codes();
+    prev_ep.push_back(ep);
+
+    codes = func->code();
+    pc = 0;
+    ep = sp - argc - 1;
+    for (int i = argc + 1; i < codes->local_size(); i++) {
+      stack_push(0);
     }
+    safepoint();
   }
   void func_ret() {
     auto r = stack_pop();
@@ -454,14 +666,21 @@ private:
   void put_self() { stack_push(stack[ep]); }
   void jump() {
     auto to = take_code();
-    pc = to.ival;
+    take_jump(to.ival);
   }
   void jump_if() {
     auto cond = stack_pop();
     auto to = take_code();
     if (cond.bval) {
-      pc = to.ival;
+      take_jump(to.ival);
+    }
+  }
+  // loops run the collector on their back edges
+  void take_jump(int to) {
+    if (to < pc) {
+      safepoint();
     }
+    pc = to;
   }
   void jump_ifnot() {
     auto cond = stack_pop();
@@ -470,16 +689,90 @@ private:
       pc = to.ival;
     }
   }
+
+  // table_switch switch_index
+  // [val] -> []
+  void table_switch() {
+    const auto &table = codes->get_switch(take_code().ival);
+    auto val = stack_pop();
+    pc = table.otherwise;
+    if (val.type == Type::INT) {
+      // one unsigned compare checks both bounds
+      unsigned offset = (unsigned)val.ival - (unsigned)table.low;
+      if (offset < table.targets.size()) {
+        pc = table.targets[offset];
+      }
+    }
+  }
+
+  // lookup_switch switch_index
+  // [val] -> []
+  void lookup_switch() {
+    const auto &table = codes->get_switch(take_code().ival);
+    auto val = stack_pop();
+    pc = table.otherwise;
+    if (val.type == Type::INT) {
+      search_switch(table, val.ival);
+    }
+  }
+
+  // hash_switch switch_index
+  // [val] -> []
+  void hash_switch() {
+    const auto &table = codes->get_switch(take_code().ival);
+    auto val = stack_pop();
+    pc = table.otherwise;
+    if (val.type == Type::INT) {
+      search_switch(table, val.ival);
+    } else if (val.type == Type::OBJECT &&
+               val.objval->klass == &Klass::String) {
+      auto it = table.strings.find(((String *)val.objval)->str);
+      if (it != table.strings.end()) {
+        pc = table.targets[it->second];
+      }
+    }
+  }
+
+  void search_switch(const CodeSequence::Switch &table, int key) {
+    auto it = std::lower_bound(table.keys.begin(), table.keys.end(), key);
+    if (it != table.keys.end() && *it == key) {
+      pc = table.targets[it - table.keys.begin()];
+    }
+  }
+  // load_class klass_name, superclass_name
+  // superclass_name is null when the definition names none
   void load_class() {
     const std::string *klass_name = take_code().sval;
+    const std::string *super_name = take_code().sval;
     auto *self = stack[ep].objval;
+    Klass *super = nullptr;
+    if (super_name != nullptr) {
+      auto it = self->fields.find(*super_name);
+      if (it == self->fields.end() ||
+          dynamic_cast<Klass *>(it->second) == nullptr) {
+        raise_error("superclass not found: " + *super_name);
+      }
+      super = (Klass *)it->second;
+      // their instances are not plain objects
+      if (super == &Klass::Int || super == &Klass::String) {
+        raise_error("can not inherit from " + *super_name);
+      }
+    }
+
     auto it = self->fields.find(*klass_name);
     Klass *klass;
     if (it == self->fields.end()) {
-      klass = new Klass(*klass_name);
-      self->set_field(*klass_name, klass);
+      klass = Heap::get().make<Klass>(*klass_name);
+      // self may have been promoted by the allocation
+      stack[ep].objval->set_field(*klass_name, klass);
+      if (super != nullptr) {
+        klass->set_superclass(super);
+      }
     } else {
       klass = (Klass *)it->second;
+      if (super != nullptr && super != klass->superclass()) {
+        raise_error("superclass mismatch for class " + *klass_name);
+      }
     }
     stack_push(klass);
 
@@ -492,6 +785,10 @@ private:
     load_ep();
   }
 
+  // raise
+  // [val] -> []
+  void raise() { throw RaiseException(stack_pop()); }
+
   void load_obj_field() {
     const std::string &field = *take_code().sval;
     Value val = stack_pop();
@@ -499,42 +796,38 @@ private:
   }
 
   // import
-  // [str] -> []
+  // [str] -> [val]
+  // a module is run by its first import, later ones put true
   void import() {
     Value target = stack_pop();
-    std::string path = target.to_s();
-    if (path.front() != '.') {
-      for (const auto &prefix : import_search_path) {
-        std::string candidate = prefix + '/' + path;
-        std::ifstream ifs(candidate);
-        if (ifs.is_open()) {
-          path = std::move(candidate);
-          break;
+    ModuleLoader &loader = ModuleLoader::get();
+    std::string path = ModuleLoader::resolve(target.to_s());
+    if (loader.is_loaded(path)) {
+      stack_push(true);
+      return;
+    }
+    CodeSequence *other_codes;
+    {
+      // an import that raises leaves the heap running and nothing behind
+      HeapPause pause;
+      std::unique_ptr<ParsedModule> module = loader.take(path);
+      if (module == nullptr) {
+        module = ModuleLoader::parse(path);
+        if (module == nullptr) {
+          raise_error(path + ": Not found.");
         }
+        loader.preload(module->imports);
       }
+      std::unique_ptr<CodeSequence> compiled(new CodeSequence(path));
+      ModuleLoader::compile(std::move(module), *compiled);
+      other_codes = compiled.release();
+      Heap::get().add_root(other_codes);
     }
-    std::ifstream ifs(path);
-    if (ifs.fail()) {
-      std::cerr << path << ": Not found." << std::endl;
-      exit(1);
-    }
-    std::istreambuf_iterator<char> it(ifs);
-    std::istreambuf_iterator<char> last;
-    std::string source_code(it, last);
-
-    std::vector<Token *> token_chain;
-    holang::Lexer lexer(source_code);
-    lexer.lex(token_chain);
-
-    holang::Parser parser(token_chain);
-    Node *root = parser.parse();
-    CodeSequence *other_codes = new CodeSequence(path);
-    root->code_gen(other_codes);
-    other_codes->append(Instruction::RET);
+    loader.add_loaded(path, other_codes);
     auto self = stack[ep];
     stack_push(self);
 
-    for (int i = 0; i < parser.toplevel_val_size(); i++) {
+    for (int i = 0; i < other_codes->local_size(); i++) {
       stack_push(0);
     }
     prev_ep.push_back(ep);
@@ -542,7 +835,7 @@ private:
 
     codes = other_codes;
     pc = 0;
-    ep = sp - parser.toplevel_val_size() - 1;
+    ep = sp - other_codes->local_size() - 1;
   }
 
   void stack_push(int x) { stack_push(Value(x)); }
@@ -550,7 +843,7 @@ private:
   void stack_push(bool x) { stack_push(Value(x)); }
   void stack_push(Object *x) { stack_push(Value(x)); }
   void stack_push(Func *x) { stack_push(Value(x)); }
-  void stack_push(const Value &val) {
+  void stack_push(const Value val) {
     reserve_stack();
     stack[sp++] = val;
   }
@@ -559,8 +852,13 @@ private:
   Value stack_top() { return stack[sp - 1]; }
 
   Code take_code() { return codes->at(pc++); }
-  void save_current_codes() { prev_code.push_back({codes, pc}); }
-  void save_ep() { prev_ep.push_back(ep); }
+  void save_current_codes() {
+    if (prev_code.size() == prev_code.capacity()) {
+      reserve_frames();
+    }
+    prev_code.push_back({codes, pc});
+  }
+  void save_ep() { prev_class_ep.push_back({ep, prev_code.size()}); }
   void load_prev_codes() {
     auto prev = prev_code.back();
     prev_code.pop_back();
@@ -568,14 +866,15 @@ private:
     pc = prev.second;
   }
   void load_ep() {
-    ep = prev_ep.back();
-    prev_ep.pop_back();
+    ep = prev_class_ep.back().first;
+    prev_class_ep.pop_back();
   }
 
 private:
   void reserve_stack() {
     if (sp >= stack_size) {
       auto new_size = stack_size * 2;
+      charge_stack(sizeof(Value) * (new_size - stack_size));
       auto *new_stack = new Value[new_size];
       if (new_stack == nullptr) {
         std::cerr << "allocation error" << std::endl;
@@ -588,10 +887,33 @@ private:
     }
   }
 
-  void init_import_search_path();
+  // the return addresses and env pointers of calls, grown along
+  void reserve_frames() {
+    size_t new_size = std::max<size_t>(64, 2 * prev_code.capacity());
+    charge_stack((sizeof(prev_code[0]) + sizeof(prev_ep[0])) *
+                 (new_size - prev_code.capacity()));
+    prev_code.reserve(new_size);
+    prev_ep.reserve(new_size);
+  }
+
+  // stacks count against the heap limit, or recursion would not stop at it
+  void charge_stack(size_t size) {
+    Heap::get().reserve_stack(size);
+    stack_bytes += size;
+  }
+
+  // a call or a loop iteration; limits are only looked at when the
+  // countdown runs out
+  void safepoint() {
+    if (--countdown == 0) {
+      check_limits();
+    }
+    Heap::get().safepoint();
+  }
+  static void check_limits();
 
 public:
-  Codes *codes;
+  Codes *codes = nullptr;
 
 private:
   int pc = 0; // program counter
@@ -599,9 +921,16 @@ private:
   int sp = 0; // stack pointer
   int ep = 0; // env pointer
   int stack_size = 1024;
+  size_t stack_bytes = 0; // charged to the heap
   static Object *main_obj;
-  static std::vector<std::string> import_search_path;
+  static uint64_t countdown; // steps until check_limits
+  static uint64_t steps;     // taken before the current countdown
+  static uint64_t interval;  // length of the current countdown
+  static uint64_t step_limit;
+  static double deadline; // steady clock in milliseconds
   std::vector<int> prev_ep;
   std::vector<std::pair<Codes *, int>> prev_code;
+  // ep saved by class bodies, with the call depth they were entered at
+  std::vector<std::pair<int, size_t>> prev_class_ep;
 };
 } // namespace holang
@@ -0,0 +1,23 @@
+#include "holang/arena.hpp"
+#include <algorithm>
+
+using namespace std;
+using namespace holang;
+
+Arena::~Arena() {
+  for (auto it = destructors.rbegin(); it != destructors.rend(); ++it) {
+    it->destroy(it->cell);
+  }
+  for (char *chunk : chunks) {
+    delete[] chunk;
+  }
+}
+
+// cells larger than a chunk get one of their own
+void Arena::grow(size_t size) {
+  size_t n = max(size, (size_t)chunk_size);
+  top = new char[n];
+  end = top + n;
+  chunks.push_back(top);
+  bytes += n;
+}
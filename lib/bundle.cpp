@@ -0,0 +1,330 @@
+#include "holang/bundle.hpp"
+#include "holang/exception.hpp"
+#include "holang/heap.hpp"
+#include "holang/loader.hpp"
+#include "holang/selector.hpp"
+#include <cstring>
+#include <unistd.h>
+#include <unordered_set>
+
+using namespace std;
+using namespace holang;
+
+// File layout, in host byte order:
+//
+//   char magic[4], uint32 version, n_modules, n_targets
+//   n_modules times string path, uint64 offset, size
+//   n_targets times string target, uint32 module
+//   the .hoc image of each module, at offsets aligned to 8
+//
+// with strings as a uint32 length and the bytes, padded to 4. The program
+// is the first module.
+
+namespace {
+const char magic[4] = {'h', 'o', 'b', '\0'};
+
+struct Unit {
+  explicit Unit(const string &path) : path(path), codes(path) {}
+
+  string path;
+  CodeSequence codes;
+  vector<string> imports;
+  uint64_t source_hash = 0;
+  size_t source_size = 0;
+};
+
+class Writer {
+public:
+  void u32(uint32_t value) { append(&value, sizeof(value)); }
+  void u64(uint64_t value) { append(&value, sizeof(value)); }
+  void str(const string &value) {
+    u32(value.size());
+    append(value.data(), value.size());
+    align(4);
+  }
+  void align(size_t to) { out.append((to - out.size() % to) % to, '\0'); }
+  void append(const void *data, size_t size) {
+    out.append((const char *)data, size);
+  }
+  string out;
+};
+
+class Reader {
+public:
+  Reader(const char *begin, const char *end) : at(begin), end(end) {}
+
+  uint32_t u32() {
+    uint32_t value = 0;
+    read(&value, sizeof(value));
+    return value;
+  }
+  uint64_t u64() {
+    uint64_t value = 0;
+    read(&value, sizeof(value));
+    return value;
+  }
+  string str() {
+    uint32_t size = u32();
+    if (size > (size_t)(end - at)) {
+      ok = false;
+      return "";
+    }
+    string value(at, size);
+    at += min((size_t)(size + 3) / 4 * 4, (size_t)(end - at));
+    return value;
+  }
+
+  bool ok = true;
+
+private:
+  void read(void *value, size_t size) {
+    if (size > (size_t)(end - at)) {
+      ok = false;
+      return;
+    }
+    memcpy(value, at, size);
+    at += size;
+  }
+
+  const char *at;
+  const char *end;
+};
+
+// an import of a string literal, which the optimizer may have made an object
+bool is_literal(Instruction op) {
+  return op == Instruction::PUT_STRING || op == Instruction::PUT_OBJECT;
+}
+
+// Top level functions no code run by the program calls by name: the top
+// level code of every module runs, and so may the functions a running code
+// refers to, or calls by the name of. Nothing is left out when a module
+// imports a target made at run time, whose code could call any of them.
+unordered_set<const Func *> unused_functions(const vector<Unit *> &units,
+                                             size_t *n_functions) {
+  unordered_set<int> called;
+  unordered_multimap<int, Func *> uncalled; // by selector
+  unordered_set<const Func *> reached;
+  vector<const CodeSequence *> work;
+  bool dynamic_import = false;
+
+  auto reach = [&](Func *func) {
+    if (reached.insert(func).second) {
+      work.push_back(func->code());
+    }
+  };
+  auto scan = [&](const CodeSequence &codes, bool top) {
+    int env = 0; // class bodies entered
+    Instruction prev = Instruction::RET;
+    for (size_t pc = 0; pc < codes.size();
+         pc += 1 + operand_count(codes.at(pc).op)) {
+      Instruction op = codes.at(pc).op;
+      const Code *operand = &codes.at(pc) + 1;
+      switch (op) {
+      case Instruction::LOAD_CLASS:
+        env++;
+        break;
+      case Instruction::PREV_ENV:
+        env--;
+        break;
+      case Instruction::PUT_LAMBDA:
+      case Instruction::CALL_DIRECT:
+        reach(operand[0].funcval);
+        break;
+      case Instruction::CALL_FUNC: {
+        int selector = operand[0].ival;
+        if (called.insert(selector).second) {
+          auto range = uncalled.equal_range(selector);
+          for (auto it = range.first; it != range.second; ++it) {
+            reach(it->second);
+          }
+          uncalled.erase(selector);
+        }
+        break;
+      }
+      case Instruction::DEF_FUNC: {
+        int selector = operand[0].ival;
+        Func *func = (Func *)operand[1].objval;
+        if (top && env == 0) {
+          ++*n_functions;
+        }
+        if (top && env == 0 && called.count(selector) == 0) {
+          uncalled.emplace(selector, func);
+        } else {
+          reach(func);
+        }
+        break;
+      }
+      case Instruction::IMPORT:
+        if (!is_literal(prev)) {
+          dynamic_import = true;
+        }
+        break;
+      default:
+        break;
+      }
+      prev = op;
+    }
+  };
+
+  *n_functions = 0;
+  for (Unit *unit : units) {
+    scan(unit->codes, true);
+  }
+  while (!work.empty()) {
+    const CodeSequence *codes = work.back();
+    work.pop_back();
+    scan(*codes, false);
+  }
+  unordered_set<const Func *> unused;
+  if (!dynamic_import) {
+    // a sealed function is called directly, not by name
+    for (const auto &entry : uncalled) {
+      if (reached.count(entry.second) == 0) {
+        unused.insert(entry.second);
+      }
+    }
+  }
+  return unused;
+}
+} // namespace
+
+Bundle::Stats Bundle::write(const string &main, const string &path) {
+  vector<unique_ptr<Unit>> units;
+  unordered_map<string, uint32_t> module_ids; // by resolved path
+  vector<pair<string, uint32_t>> target_ids;
+  unordered_set<string> targets_seen;
+  units.emplace_back(new Unit(ModuleLoader::canonical(main)));
+  module_ids.emplace(units[0]->path, 0);
+
+  // the modules are not roots, and are only needed until they are encoded
+  HeapPause pause;
+  for (size_t i = 0; i < units.size(); i++) {
+    Unit &unit = *units[i];
+    unique_ptr<ParsedModule> module = ModuleLoader::parse(unit.path);
+    if (module == nullptr) {
+      throw runtime_error(unit.path + ": Not found.");
+    }
+    unit.imports = module->imports;
+    unit.source_hash = module->source_hash;
+    unit.source_size = module->source_size;
+    ModuleLoader::compile(move(module), unit.codes);
+    for (const auto &target : unit.imports) {
+      if (!targets_seen.insert(target).second) {
+        continue;
+      }
+      // a target that is not found raises when it is imported, as it would
+      // without the bundle
+      string module_path = ModuleLoader::resolve(target);
+      if (access(module_path.c_str(), R_OK) != 0) {
+        continue;
+      }
+      auto it = module_ids.emplace(module_path, units.size()).first;
+      if (it->second == units.size()) {
+        units.emplace_back(new Unit(module_path));
+      }
+      target_ids.emplace_back(target, it->second);
+    }
+  }
+
+  vector<Unit *> all;
+  for (const auto &unit : units) {
+    all.push_back(unit.get());
+  }
+  Stats stats;
+  stats.modules = units.size();
+  unordered_set<const Func *> unused = unused_functions(all, &stats.functions);
+  stats.stripped = unused.size();
+
+  vector<string> images;
+  for (const auto &unit : units) {
+    images.emplace_back();
+    if (!Bytecode::encode(unit->codes, unit->source_hash, unit->source_size,
+                          unit->imports, &images.back(), unused)) {
+      throw runtime_error(unit->path + ": can not be bundled");
+    }
+  }
+
+  Writer out;
+  out.append(magic, sizeof(magic));
+  out.u32(version);
+  out.u32(units.size());
+  out.u32(target_ids.size());
+  vector<size_t> offset_at; // of each module, known once written
+  for (const auto &unit : units) {
+    out.str(unit->path);
+    offset_at.push_back(out.out.size());
+    out.u64(0);
+    out.u64(0);
+  }
+  for (const auto &target : target_ids) {
+    out.str(target.first);
+    out.u32(target.second);
+  }
+  for (size_t i = 0; i < images.size(); i++) {
+    out.align(8);
+    uint64_t place[2] = {out.out.size(), images[i].size()};
+    memcpy(&out.out[offset_at[i]], place, sizeof(place));
+    out.out += images[i];
+  }
+  if (!Bytecode::write_file(path, out.out)) {
+    throw runtime_error(path + ": can not be written");
+  }
+  stats.bytes = out.out.size();
+  return stats;
+}
+
+bool Bundle::is_bundle(const SourceFile &file) {
+  return file.size() >= sizeof(magic) &&
+         memcmp(file.data(), magic, sizeof(magic)) == 0;
+}
+
+shared_ptr<Bundle> Bundle::open(shared_ptr<const SourceFile> file) {
+  if (!is_bundle(*file)) {
+    return nullptr;
+  }
+  Reader in(file->data() + sizeof(magic), file->data() + file->size());
+  uint32_t file_version = in.u32();
+  uint32_t n_modules = in.u32();
+  uint32_t n_targets = in.u32();
+  if (file_version != version || n_modules == 0) {
+    return nullptr;
+  }
+  shared_ptr<Bundle> bundle(new Bundle);
+  for (uint32_t i = 0; i < n_modules && in.ok; i++) {
+    string path = in.str();
+    uint64_t offset = in.u64();
+    uint64_t size = in.u64();
+    if (!in.ok) {
+      break;
+    }
+    auto code = Bytecode::open(file, offset, size, path);
+    if (code == nullptr) {
+      return nullptr;
+    }
+    bundle->paths.push_back(path);
+    bundle->modules.emplace(path, move(code));
+  }
+  for (uint32_t i = 0; i < n_targets && in.ok; i++) {
+    string target = in.str();
+    uint32_t module = in.u32();
+    if (module >= bundle->paths.size()) {
+      return nullptr;
+    }
+    bundle->targets.emplace(target, bundle->paths[module]);
+  }
+  return in.ok ? bundle : nullptr;
+}
+
+shared_ptr<Bytecode> Bundle::module(const string &path) const {
+  auto it = modules.find(path);
+  return it == modules.end() ? nullptr : it->second;
+}
+
+bool Bundle::resolve(const string &target, string *path) const {
+  auto it = targets.find(target);
+  if (it == targets.end()) {
+    return false;
+  }
+  *path = it->second;
+  return true;
+}
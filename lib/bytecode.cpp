@@ -0,0 +1,823 @@
+#include "holang/bytecode.hpp"
+#include "config.hpp"
+#include "holang/heap.hpp"
+#include "holang/string.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <unordered_set>
+
+using namespace std;
+using namespace holang;
+
+// File layout, in host byte order:
+//
+//   Header
+//   uint32 offsets[n_funcs + 1]   records: top level code, then functions
+//   strings                       uint32 length, the bytes, padded to 4
+//   uint32 imports[n_imports]     string indices
+//   records
+//
+// A record is
+//
+//   uint32 sealed, local_size
+//   uint32 n_refs, function indices the code refers to
+//   uint32 n_codes, 8 bytes each
+//   uint32 n_handlers, int32 begin, end, target, env each
+//   uint32 n_switches, each
+//     int32 low, otherwise
+//     uint32 n_keys, int32 keys
+//     uint32 n_targets, int32 targets
+//     uint32 n_strings, uint32 string, int32 target each
+//
+// with the operands that are pointers at run time, and selectors, stored as
+// indices. The checksum of the header covers everything after it, and every
+// record is checked when the file is opened, so a damaged file is a miss
+// rather than code that jumps or reads anywhere.
+
+namespace {
+const char magic[4] = {'h', 'o', 'c', '\0'};
+const uint32_t no_string = UINT32_MAX; // LOAD_CLASS without a superclass
+
+struct Header {
+  char magic[4];
+  uint32_t version;
+  uint64_t build_id; // of the sources the compiler was built from
+  uint64_t source_hash;
+  uint64_t source_size;
+  uint64_t file_size;
+  uint64_t checksum; // FNV-1a of the rest of the file
+  uint32_t n_strings;
+  uint32_t n_imports;
+  uint32_t n_funcs;
+  uint32_t code_size; // sizeof(Code)
+};
+
+// the code refers to something that can not be written
+struct Unsupported {};
+
+// one the VM runs, read from a file
+bool is_instruction(Instruction op) {
+  return (unsigned)op <= (unsigned)Instruction::RAISE &&
+         op != Instruction::PUT_ENV;
+}
+
+class Writer {
+public:
+  void u32(uint32_t value) { append(&value, sizeof(value)); }
+  void i32(int32_t value) { append(&value, sizeof(value)); }
+  void code(Code value) { append(&value, sizeof(value)); }
+  void index(uint32_t value) {
+    Code code;
+    memset(&code, 0, sizeof(code));
+    code.ival = value;
+    append(&code, sizeof(code));
+  }
+  void str(const string &value) {
+    u32(value.size());
+    append(value.data(), value.size());
+    out.append((4 - value.size() % 4) % 4, '\0');
+  }
+  void append(const void *data, size_t size) {
+    out.append((const char *)data, size);
+  }
+  string out;
+};
+
+// numbers the strings and functions of a module while writing its records
+class Encoder {
+public:
+  Encoder(const CodeSequence &top,
+          const unordered_set<const Func *> &stripped) {
+    records.push_back(record(top, false));
+    // functions found while writing a record are appended
+    for (size_t i = 0; i < funcs.size(); i++) {
+      Func *func = funcs[i];
+      if (func->type != FUSERDEF) {
+        throw Unsupported();
+      }
+      if (stripped.count(func) != 0) {
+        records.push_back(record(stub(func), func->sealed));
+      } else {
+        records.push_back(record(*func->code(), func->sealed));
+      }
+    }
+  }
+
+  uint32_t string_index(const string &str) {
+    auto it = string_ids.emplace(str, strings.size()).first;
+    if (it->second == strings.size()) {
+      strings.push_back(&it->first);
+    }
+    return it->second;
+  }
+
+  vector<const string *> strings;
+  vector<Func *> funcs;
+  vector<string> records;
+
+private:
+  // raises the name it was defined with, found before its record is written
+  CodeSequence stub(Func *func) {
+    CodeSequence codes;
+    codes.append(Instruction::PUT_STRING);
+    codes.append(CodeSequence::intern(names[func] +
+                                      ": left out of the bundle"));
+    codes.append(Instruction::RAISE);
+    return codes;
+  }
+
+  uint32_t func_index(Func *func) {
+    auto it = func_ids.emplace(func, funcs.size()).first;
+    if (it->second == funcs.size()) {
+      funcs.push_back(func);
+    }
+    refs.push_back(it->second);
+    return it->second;
+  }
+
+  string record(const CodeSequence &codes, bool sealed) {
+    Writer words;
+    refs.clear();
+    size_t pc = 0;
+    while (pc < codes.size()) {
+      Instruction op = codes.at(pc).op;
+      words.code(codes.at(pc));
+      const Code *operand = &codes.at(pc) + 1;
+      switch (op) {
+      case Instruction::PUT_STRING:
+      case Instruction::LOAD_OBJ_FIELD:
+        words.index(string_index(*operand[0].sval));
+        break;
+      case Instruction::PUT_OBJECT:
+        // made by the optimizer from a string literal
+        if (operand[0].objval->klass != &Klass::String) {
+          throw Unsupported();
+        }
+        words.index(string_index(((String *)operand[0].objval)->str));
+        break;
+      case Instruction::PUT_LAMBDA:
+        words.index(func_index(operand[0].funcval));
+        break;
+      case Instruction::CALL_DIRECT:
+        words.index(func_index(operand[0].funcval));
+        words.code(operand[1]);
+        break;
+      case Instruction::CALL_FUNC:
+        words.index(string_index(Selectors::name(operand[0].ival)));
+        words.code(operand[1]);
+        break;
+      case Instruction::DEF_FUNC:
+        names.emplace((Func *)operand[1].objval,
+                      Selectors::name(operand[0].ival));
+        words.index(string_index(Selectors::name(operand[0].ival)));
+        words.index(func_index((Func *)operand[1].objval));
+        break;
+      case Instruction::LOAD_CLASS:
+        words.index(string_index(*operand[0].sval));
+        words.index(operand[1].sval == nullptr
+                        ? no_string
+                        : string_index(*operand[1].sval));
+        break;
+      default:
+        if (op > Instruction::RAISE) {
+          throw Unsupported();
+        }
+        for (int i = 0; i < operand_count(op); i++) {
+          words.code(operand[i]);
+        }
+        break;
+      }
+      pc += 1 + operand_count(op);
+    }
+
+    Writer out;
+    out.u32(sealed);
+    out.u32(codes.local_size());
+    out.u32(refs.size());
+    for (uint32_t ref : refs) {
+      out.u32(ref);
+    }
+    out.u32(codes.size());
+    out.out += words.out;
+    out.u32(codes.get_handlers().size());
+    for (const auto &handler : codes.get_handlers()) {
+      out.i32(handler.begin);
+      out.i32(handler.end);
+      out.i32(handler.target);
+      out.i32(handler.env);
+    }
+    out.u32(codes.get_switches().size());
+    for (const auto &table : codes.get_switches()) {
+      out.i32(table.low);
+      out.i32(table.otherwise);
+      out.u32(table.keys.size());
+      for (int key : table.keys) {
+        out.i32(key);
+      }
+      out.u32(table.targets.size());
+      for (int target : table.targets) {
+        out.i32(target);
+      }
+      out.u32(table.strings.size());
+      for (const auto &entry : table.strings) {
+        out.u32(string_index(entry.first));
+        out.i32(entry.second);
+      }
+    }
+    return move(out.out);
+  }
+
+  unordered_map<string, uint32_t> string_ids;
+  unordered_map<Func *, uint32_t> func_ids;
+  unordered_map<Func *, string> names; // as defined
+  vector<uint32_t> refs; // of the record being written
+};
+
+string default_cache_dir() {
+  if (const char *dir = getenv("HOLANG_CACHE_DIR")) {
+    return dir;
+  }
+  if (const char *dir = getenv("XDG_CACHE_HOME")) {
+    return string(dir) + "/holang";
+  }
+  if (const char *home = getenv("HOME")) {
+    return string(home) + "/.cache/holang";
+  }
+  return "";
+}
+
+// mkdir -p
+bool make_dirs(const string &dir) {
+  for (size_t i = 1; i <= dir.size(); i++) {
+    if (i == dir.size() || dir[i] == '/') {
+      mkdir(dir.substr(0, i).c_str(), 0755);
+    }
+  }
+  struct stat st;
+  return stat(dir.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+} // namespace
+
+// Reads a record. Past the end of the file it reads zeros, and the error is
+// reported once the record is read.
+class Bytecode::Reader {
+public:
+  Reader(const char *begin, const char *end) : at(begin), end(end) {}
+
+  uint32_t u32() {
+    uint32_t value = 0;
+    read(&value, sizeof(value));
+    return value;
+  }
+  int32_t i32() {
+    int32_t value = 0;
+    read(&value, sizeof(value));
+    return value;
+  }
+  Code code() {
+    Code value;
+    memset(&value, 0, sizeof(value));
+    read(&value, sizeof(value));
+    return value;
+  }
+  uint32_t index() { return code().ival; }
+  string str() {
+    uint32_t size = u32();
+    if (size > (size_t)(end - at)) {
+      ok = false;
+      return "";
+    }
+    string value(at, size);
+    skip((size + 3) / 4 * 4);
+    return value;
+  }
+  void skip(size_t size) {
+    if (size > (size_t)(end - at)) {
+      ok = false;
+    }
+    at += min(size, (size_t)(end - at));
+  }
+
+  const char *at;
+  const char *end;
+  bool ok = true;
+
+private:
+  void read(void *value, size_t size) {
+    if (size > (size_t)(end - at)) {
+      ok = false;
+      return;
+    }
+    memcpy(value, at, size);
+    at += size;
+  }
+};
+
+// the functions made from a file, referred by index from its code
+struct Bytecode::Module {
+  shared_ptr<const Bytecode> file;
+  vector<Func *> funcs;
+};
+
+// A function body decoded on its first call. Until then it keeps the
+// functions its code refers to alive.
+class Bytecode::Body : public LazyBody {
+public:
+  Body(shared_ptr<Module> module, uint32_t index, const string &source_path)
+      : module(move(module)), index(index), source_path(source_path) {}
+
+  shared_ptr<const CodeSequence> compile() override {
+    if (code == nullptr) {
+      auto body_code = make_shared<CodeSequence>(source_path);
+      Heap::get().pause();
+      // checked when the file was opened
+      module->file->decode(index + 1, *body_code, module->funcs);
+      Heap::get().resume();
+      code = body_code;
+      module.reset();
+    }
+    return code;
+  }
+
+  void trace(Heap &heap) override {
+    if (module == nullptr) {
+      return;
+    }
+    Reader in(module->file->record(index + 1), module->file->end());
+    in.skip(2 * sizeof(uint32_t));
+    uint32_t n_refs = in.u32();
+    for (uint32_t i = 0; i < n_refs && in.ok; i++) {
+      uint32_t ref = in.u32();
+      if (ref < module->funcs.size()) {
+        heap.mark(module->funcs[ref]);
+      }
+    }
+  }
+
+private:
+  shared_ptr<Module> module;
+  uint32_t index; // in the function table
+  const string &source_path; // interned
+  shared_ptr<const CodeSequence> code;
+};
+
+uint64_t Bytecode::hash(const char *text, size_t size) {
+  uint64_t hash = 14695981039346656037ull;
+  for (size_t i = 0; i < size; i++) {
+    hash ^= (unsigned char)text[i];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+string &Bytecode::cache_dir() {
+  static string dir = default_cache_dir();
+  return dir;
+}
+
+string Bytecode::path_of(const string &dir, uint64_t source_hash) {
+  char name[32];
+  snprintf(name, sizeof(name), "/%016llx.hoc",
+           (unsigned long long)source_hash);
+  return dir + name;
+}
+
+// the holib image first, it is not written at run time
+shared_ptr<Bytecode> Bytecode::load(uint64_t source_hash,
+                                    size_t source_size) {
+  if (!enabled()) {
+    return nullptr;
+  }
+#ifdef PATH_HOLIB_IMAGE
+  const string dirs[] = {PATH_HOLIB_IMAGE, cache_dir()};
+#else
+  const string dirs[] = {cache_dir()};
+#endif
+  for (const auto &dir : dirs) {
+    string path = path_of(dir, source_hash);
+    auto file = make_shared<const SourceFile>(path);
+    if (file->fail()) {
+      continue;
+    }
+    shared_ptr<Bytecode> code = open(file, 0, file->size(), path);
+    if (code != nullptr && code->source_hash == source_hash &&
+        code->source_size == source_size) {
+      return code;
+    }
+  }
+  return nullptr;
+}
+
+shared_ptr<Bytecode> Bytecode::open(shared_ptr<const SourceFile> file,
+                                    size_t offset, size_t size,
+                                    const string &path) {
+  if (offset > file->size() || size > file->size() - offset) {
+    return nullptr;
+  }
+  shared_ptr<Bytecode> code(new Bytecode(path, move(file), offset, size));
+  return code->read_header() ? code : nullptr;
+}
+
+bool Bytecode::read_header() {
+  Header header;
+  if (size < sizeof(header)) {
+    return false;
+  }
+  memcpy(&header, begin, sizeof(header));
+  if (memcmp(header.magic, magic, sizeof(magic)) != 0 ||
+      header.version != version || header.build_id != HOLANG_BUILD_ID ||
+      header.code_size != sizeof(Code) || header.file_size != size ||
+      header.checksum != hash(begin + sizeof(header), size - sizeof(header))) {
+    return false;
+  }
+  source_hash = header.source_hash;
+  source_size = header.source_size;
+
+  Reader in(begin + sizeof(header), end());
+  for (uint32_t i = 0; i <= header.n_funcs && in.ok; i++) {
+    offsets.push_back(in.u32());
+    if (offsets.back() >= size) {
+      return false;
+    }
+  }
+  for (uint32_t i = 0; i < header.n_strings && in.ok; i++) {
+    strings.push_back(CodeSequence::intern(in.str()));
+  }
+  for (uint32_t i = 0; i < header.n_imports && in.ok; i++) {
+    uint32_t index = in.u32();
+    if (index >= strings.size()) {
+      return false;
+    }
+    import_targets.push_back(*strings[index]);
+  }
+  if (!in.ok) {
+    return false;
+  }
+  for (uint32_t i = 0; i < offsets.size(); i++) {
+    if (!check(i)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// what decode would make of the record is code the VM can run: operands
+// index the pools, locals and tables of the file, and every target is an
+// instruction of the record
+bool Bytecode::check(uint32_t index) const {
+  Reader in(record(index), end());
+  in.u32(); // sealed
+  int32_t local_size = in.i32();
+  uint32_t n_refs = in.u32();
+  for (uint32_t i = 0; i < n_refs && in.ok; i++) {
+    if (in.u32() >= offsets.size() - 1) {
+      return false;
+    }
+  }
+  auto string_ok = [&](uint32_t i) { return i < strings.size(); };
+  auto func_ok = [&](uint32_t i) { return i < offsets.size() - 1; };
+  auto local_ok = [&](int32_t i) { return 0 <= i && i < local_size; };
+
+  uint32_t n_codes = in.u32();
+  vector<bool> starts(n_codes + 1, false);
+  vector<int32_t> jumps;
+  vector<uint32_t> tables;
+  Instruction last = Instruction::RET;
+  uint32_t pc = 0;
+  bool ok = n_codes > 0;
+  while (pc < n_codes && in.ok && ok) {
+    Instruction op = in.code().op;
+    if (!is_instruction(op) || pc + 1 + operand_count(op) > n_codes) {
+      return false;
+    }
+    starts[pc] = true;
+    last = op;
+    switch (op) {
+    case Instruction::PUT_STRING:
+    case Instruction::LOAD_OBJ_FIELD:
+    case Instruction::PUT_OBJECT:
+      ok = string_ok(in.index());
+      break;
+    case Instruction::PUT_LAMBDA:
+      ok = func_ok(in.index());
+      break;
+    case Instruction::CALL_DIRECT:
+      ok = func_ok(in.index());
+      ok = in.code().ival >= 0 && ok;
+      break;
+    case Instruction::CALL_FUNC:
+      ok = string_ok(in.index());
+      ok = in.code().ival >= 0 && ok;
+      break;
+    case Instruction::DEF_FUNC:
+      ok = string_ok(in.index());
+      ok = func_ok(in.index()) && ok;
+      break;
+    case Instruction::LOAD_CLASS: {
+      ok = string_ok(in.index());
+      uint32_t super = in.index();
+      ok = (super == no_string || string_ok(super)) && ok;
+      break;
+    }
+    case Instruction::STORE_LOCAL:
+    case Instruction::LOAD_LOCAL:
+      ok = local_ok(in.code().ival);
+      break;
+    case Instruction::ADD_LOCAL_CONST:
+    case Instruction::INC_LOCAL:
+    case Instruction::SUB_LOCAL_CONST:
+    case Instruction::DEC_LOCAL:
+      ok = local_ok(in.code().ival);
+      in.code();
+      break;
+    case Instruction::JUMP:
+    case Instruction::JUMP_IF:
+    case Instruction::JUMP_IFNOT:
+      jumps.push_back(in.code().ival);
+      break;
+    case Instruction::TABLE_SWITCH:
+    case Instruction::LOOKUP_SWITCH:
+    case Instruction::HASH_SWITCH:
+      tables.push_back(in.code().ival);
+      break;
+    default:
+      in.skip(operand_count(op) * sizeof(Code));
+      break;
+    }
+    pc += 1 + operand_count(op);
+  }
+  // the VM stops at nothing but these
+  if (!ok || !in.ok || (last != Instruction::RET &&
+                        last != Instruction::JUMP &&
+                        last != Instruction::RAISE)) {
+    return false;
+  }
+  auto target_ok = [&](int32_t to) {
+    return 0 <= to && (uint32_t)to < n_codes && starts[to];
+  };
+  for (int32_t to : jumps) {
+    if (!target_ok(to)) {
+      return false;
+    }
+  }
+
+  uint32_t n_handlers = in.u32();
+  for (uint32_t i = 0; i < n_handlers && in.ok; i++) {
+    int32_t begin = in.i32();
+    int32_t end = in.i32();
+    int32_t target = in.i32();
+    int32_t env = in.i32();
+    if (begin < 0 || end < begin || (uint32_t)end > n_codes ||
+        !target_ok(target) || env < 0) {
+      return false;
+    }
+  }
+  uint32_t n_switches = in.u32();
+  for (uint32_t table : tables) {
+    if (table >= n_switches) {
+      return false;
+    }
+  }
+  for (uint32_t i = 0; i < n_switches && in.ok; i++) {
+    in.i32(); // low
+    if (!target_ok(in.i32())) {
+      return false;
+    }
+    uint32_t n_keys = in.u32();
+    in.skip(n_keys * sizeof(int32_t));
+    uint32_t n_targets = in.u32();
+    if (n_keys > n_targets) {
+      return false;
+    }
+    for (uint32_t k = 0; k < n_targets && in.ok; k++) {
+      if (!target_ok(in.i32())) {
+        return false;
+      }
+    }
+    uint32_t n_strings = in.u32();
+    for (uint32_t k = 0; k < n_strings && in.ok; k++) {
+      if (!string_ok(in.u32()) || in.u32() >= n_targets) {
+        return false;
+      }
+    }
+  }
+  return in.ok;
+}
+
+const char *Bytecode::record(uint32_t index) const {
+  return begin + offsets[index];
+}
+
+bool Bytecode::instantiate(CodeSequence &codes) const {
+  auto module = make_shared<Module>();
+  module->file = shared_from_this();
+  for (uint32_t i = 1; i < offsets.size(); i++) {
+    Func *func = Heap::get().make<Func>();
+    func->sealed = Reader(record(i), end()).u32() != 0;
+    module->funcs.push_back(func);
+  }
+  for (uint32_t i = 0; i < module->funcs.size(); i++) {
+    module->funcs[i]->lazy = make_shared<Body>(module, i, codes.source_path);
+  }
+  if (!decode(0, codes, module->funcs)) {
+    codes.clear();
+    return false;
+  }
+  return true;
+}
+
+bool Bytecode::decode(uint32_t index, CodeSequence &codes,
+                      const vector<Func *> &funcs) const {
+  Reader in(record(index), end());
+  auto string_at = [&](uint32_t i) {
+    if (i >= strings.size()) {
+      in.ok = false;
+      return strings.empty() ? CodeSequence::intern("") : strings[0];
+    }
+    return strings[i];
+  };
+  auto func_at = [&](uint32_t i) -> Func * {
+    if (i >= funcs.size()) {
+      in.ok = false;
+      return nullptr;
+    }
+    return funcs[i];
+  };
+
+  in.u32(); // sealed
+  codes.set_local_size(in.u32());
+  in.skip(in.u32() * sizeof(uint32_t));
+  uint32_t n_codes = in.u32();
+  uint32_t pc = 0;
+  while (pc < n_codes && in.ok) {
+    Code insn = in.code();
+    Instruction op = insn.op;
+    if (!is_instruction(op)) {
+      in.ok = false;
+      break;
+    }
+    codes.append(insn);
+    switch (op) {
+    case Instruction::PUT_STRING:
+    case Instruction::LOAD_OBJ_FIELD:
+      codes.append(string_at(in.index()));
+      break;
+    case Instruction::PUT_OBJECT:
+      codes.append((Object *)Heap::get().make_old<String>(
+          *string_at(in.index())));
+      break;
+    case Instruction::PUT_LAMBDA:
+      codes.append(func_at(in.index()));
+      break;
+    case Instruction::CALL_DIRECT:
+      codes.append(func_at(in.index()));
+      codes.append(in.code());
+      break;
+    case Instruction::CALL_FUNC:
+      codes.append((int)Selectors::of(*string_at(in.index())));
+      codes.append(in.code());
+      break;
+    case Instruction::DEF_FUNC:
+      codes.append((int)Selectors::of(*string_at(in.index())));
+      codes.append((Object *)func_at(in.index()));
+      break;
+    case Instruction::LOAD_CLASS: {
+      codes.append(string_at(in.index()));
+      uint32_t super = in.index();
+      codes.append(super == no_string ? nullptr : string_at(super));
+      break;
+    }
+    default:
+      for (int i = 0; i < operand_count(op); i++) {
+        codes.append(in.code());
+      }
+      break;
+    }
+    pc += 1 + operand_count(op);
+  }
+
+  uint32_t n_handlers = in.u32();
+  for (uint32_t i = 0; i < n_handlers && in.ok; i++) {
+    CodeSequence::Handler handler;
+    handler.begin = in.i32();
+    handler.end = in.i32();
+    handler.target = in.i32();
+    handler.env = in.i32();
+    codes.add_handler(handler);
+  }
+  uint32_t n_switches = in.u32();
+  for (uint32_t i = 0; i < n_switches && in.ok; i++) {
+    CodeSequence::Switch table;
+    table.low = in.i32();
+    table.otherwise = in.i32();
+    uint32_t n_keys = in.u32();
+    for (uint32_t k = 0; k < n_keys && in.ok; k++) {
+      table.keys.push_back(in.i32());
+    }
+    uint32_t n_targets = in.u32();
+    for (uint32_t k = 0; k < n_targets && in.ok; k++) {
+      table.targets.push_back(in.i32());
+    }
+    uint32_t n_strings = in.u32();
+    for (uint32_t k = 0; k < n_strings && in.ok; k++) {
+      const string *key = string_at(in.u32());
+      table.strings[*key] = in.i32();
+    }
+    codes.add_switch(table);
+  }
+  return in.ok;
+}
+
+void Bytecode::drop() const {
+  if (enabled() && path == path_of(cache_dir(), source_hash)) {
+    remove(path.c_str());
+  }
+}
+
+void Bytecode::save(const CodeSequence &codes, uint64_t source_hash,
+                    size_t source_size, const vector<string> &imports) {
+  string image;
+  if (!enabled() ||
+      !encode(codes, source_hash, source_size, imports, &image) ||
+      !make_dirs(cache_dir())) {
+    return;
+  }
+  write_file(path_of(cache_dir(), source_hash), image);
+}
+
+bool Bytecode::encode(const CodeSequence &codes, uint64_t source_hash,
+                      size_t source_size, const vector<string> &imports,
+                      string *image,
+                      const unordered_set<const Func *> &stripped) {
+  Writer out;
+  try {
+    Encoder encoder(codes, stripped);
+    vector<uint32_t> import_ids;
+    for (const auto &target : imports) {
+      import_ids.push_back(encoder.string_index(target));
+    }
+
+    Header header;
+    memcpy(header.magic, magic, sizeof(magic));
+    header.version = version;
+    header.build_id = HOLANG_BUILD_ID;
+    header.source_hash = source_hash;
+    header.source_size = source_size;
+    header.file_size = 0; // known at the end
+    header.n_strings = encoder.strings.size();
+    header.n_imports = import_ids.size();
+    header.n_funcs = encoder.funcs.size();
+    header.code_size = sizeof(Code);
+
+    Writer pool;
+    for (const string *str : encoder.strings) {
+      pool.str(*str);
+    }
+    for (uint32_t id : import_ids) {
+      pool.u32(id);
+    }
+    size_t offset = sizeof(header) +
+                    encoder.records.size() * sizeof(uint32_t) +
+                    pool.out.size();
+    out.append(&header, sizeof(header));
+    for (const auto &record : encoder.records) {
+      out.u32(offset);
+      offset += record.size();
+    }
+    out.out += pool.out;
+    for (const auto &record : encoder.records) {
+      out.out += record;
+    }
+    header.file_size = out.out.size();
+    header.checksum = hash(out.out.data() + sizeof(header),
+                           out.out.size() - sizeof(header));
+    memcpy(&out.out[0], &header, sizeof(header));
+  } catch (const Unsupported &) {
+    return false;
+  }
+  *image = move(out.out);
+  return true;
+}
+
+bool Bytecode::write_file(const string &path, const string &data) {
+  string temp = path + "." + to_string(getpid());
+  {
+    ofstream file(temp, ios::binary);
+    file.write(data.data(), data.size());
+    if (!file.good()) {
+      file.close();
+      remove(temp.c_str());
+      return false;
+    }
+  }
+  if (rename(temp.c_str(), path.c_str()) != 0) {
+    remove(temp.c_str());
+    return false;
+  }
+  return true;
+}
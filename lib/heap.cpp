@@ -0,0 +1,414 @@
+#include "holang/heap.hpp"
+#include "holang/vm.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <numeric>
+
+using namespace std;
+using namespace holang;
+
+namespace {
+// cells traced or swept between two reads of the clock
+const size_t slice_budget = 256;
+
+double now_ms() {
+  chrono::duration<double, milli> now =
+      chrono::steady_clock::now().time_since_epoch();
+  return now.count();
+}
+} // namespace
+
+void Heap::remove_vm(HolangVM *vm) {
+  vms.erase(std::find(vms.begin(), vms.end(), vm));
+}
+
+void Heap::track(Object *obj) {
+  size_t size = obj->heap_size();
+  reserve(size, obj, nullptr);
+  objects.push_back({obj, size});
+  if (phase == Phase::Marking) {
+    mark(obj);
+  }
+}
+
+void Heap::track(Func *func) {
+  size_t size = sizeof(Func);
+  reserve(size, nullptr, func);
+  funcs.push_back({func, size});
+  if (phase == Phase::Marking) {
+    mark(func);
+  }
+}
+
+// new_obj or new_func is not registered yet and is kept alive with
+// everything it already points to
+void Heap::reserve(size_t size, Object *new_obj, Func *new_func) {
+  collect_old(size, new_obj, new_func);
+  if (limit != 0 && bytes + stack_bytes + size > limit && paused == 0) {
+    throw LimitExceeded("heap limit exceeded: " +
+                        to_string(bytes + stack_bytes + size) + " > " +
+                        to_string(limit) + " bytes");
+  }
+  bytes += size;
+  peak_bytes = max(peak_bytes, bytes);
+}
+
+// stacks are not collected, deep recursion runs out of them instead
+void Heap::reserve_stack(size_t size) {
+  if (limit != 0 && bytes + stack_bytes + size > limit) {
+    throw LimitExceeded("heap limit exceeded: " +
+                        to_string(bytes + stack_bytes + size) + " > " +
+                        to_string(limit) + " bytes, " +
+                        to_string(stack_bytes + size) + " of them stacks");
+  }
+  stack_bytes += size;
+}
+
+// the nursery is full
+void Heap::collect_young() {
+  if (young_begin == nullptr) {
+    size_t size = nursery_size;
+    if (limit != 0) {
+      size = min(size, limit / 4);
+    }
+    young_begin = young_top = new char[size];
+    young_end = young_begin + size;
+    return;
+  }
+
+  minor_collect();
+  collect_old(0, nullptr, nullptr);
+  if (limit != 0 && bytes + stack_bytes > limit && paused == 0) {
+    throw LimitExceeded("heap limit exceeded: " +
+                        to_string(bytes + stack_bytes) + " > " +
+                        to_string(limit) + " bytes");
+  }
+}
+
+// the old space is about to grow by size bytes; it is collected in one pause
+// when incremental collection is off or is outrun by the mutator
+void Heap::collect_old(size_t size, Object *new_obj, Func *new_func) {
+  bool over_limit = limit != 0 && bytes + size > limit;
+  if (paused != 0 || (bytes + size <= next_gc && !over_limit)) {
+    return;
+  }
+  if (pause_target > 0 && !over_limit && bytes + size <= 2 * next_gc) {
+    if (phase == Phase::Idle) {
+      start_cycle();
+    }
+    return;
+  }
+  collect(new_obj, new_func);
+}
+
+void Heap::minor_collect() {
+  auto begin = chrono::steady_clock::now();
+
+  for (auto *vm : vms) {
+    vm->forward_roots(*this);
+  }
+  for (auto *obj : remembered) {
+    obj->remembered = false;
+    promoted_objects.push_back(obj);
+  }
+  remembered.clear();
+  while (!promoted_objects.empty()) {
+    Object *obj = promoted_objects.back();
+    promoted_objects.pop_back();
+    for (auto &field : obj->fields) {
+      forward(field.second);
+    }
+  }
+
+  // the dead are destroyed in place, without being traced
+  for (char *cell = young_begin; cell < young_top;) {
+    auto *header = (YoungHeader *)cell;
+    auto *obj = (Object *)(header + 1);
+    if (obj->forward == nullptr) {
+      freed++;
+    }
+    obj->~Object();
+    cell += header->size;
+  }
+  young_top = young_begin;
+
+  chrono::duration<double, milli> pause = chrono::steady_clock::now() - begin;
+  minor_collections++;
+  minor_pauses.push_back(pause.count());
+}
+
+void Heap::forward(Object *&ref) {
+  if (!is_young(ref)) {
+    return;
+  }
+  if (ref->forward == nullptr) {
+    Object *copy = ref->promote();
+    copy->forward = nullptr;
+    size_t size = copy->heap_size();
+    objects.push_back({copy, size});
+    bytes += size;
+    peak_bytes = max(peak_bytes, bytes);
+    promoted++;
+    ref->forward = copy;
+    promoted_objects.push_back(copy);
+    if (phase == Phase::Marking) {
+      mark(copy);
+    }
+  }
+  ref = ref->forward;
+}
+
+void Heap::forward(Value &value) {
+  if (value.type == Type::OBJECT) {
+    forward(value.objval);
+  }
+}
+
+void Heap::collect(Object *new_obj, Func *new_func) {
+  // an unfinished incremental cycle is dropped, its sweep is completed
+  if (phase == Phase::Marking) {
+    phase = Phase::Idle;
+    gray_objects.clear();
+    gray_funcs.clear();
+  }
+  if (young_top != young_begin) {
+    minor_collect();
+  }
+  double begin = now_ms();
+  if (phase == Phase::Sweeping) {
+    sweep_some(SIZE_MAX);
+    finish_sweep();
+  }
+
+  epoch++;
+  mark(new_obj);
+  mark(new_func);
+  mark_roots();
+  trace();
+  sweep();
+
+  collections++;
+  pauses.push_back(now_ms() - begin);
+}
+
+void Heap::mark_roots() {
+  mark(&Klass::Int);
+  mark(&Klass::String);
+  for (const auto *codes : root_codes) {
+    mark(*codes);
+  }
+  for (auto *vm : vms) {
+    vm->mark_roots(*this);
+  }
+}
+
+void Heap::start_cycle() {
+  double begin = now_ms();
+  epoch++;
+  phase = Phase::Marking;
+  mark_roots();
+  collections++;
+  last_step = now_ms();
+  pauses.push_back(last_step - begin);
+}
+
+// one slice, unless the previous one ended less than a slice ago; the mutator
+// runs at least half of the time during a cycle
+void Heap::step() {
+  double begin = now_ms();
+  if (begin - last_step < pause_target) {
+    return;
+  }
+  do {
+    if (phase == Phase::Marking) {
+      if (trace_some(slice_budget)) {
+        finish_marking();
+      }
+    } else if (sweep_some(slice_budget)) {
+      finish_sweep();
+    }
+  } while (phase != Phase::Idle && now_ms() - begin < pause_target);
+  last_step = now_ms();
+  pauses.push_back(last_step - begin);
+}
+
+// young objects and stacks are not covered by the write barrier, so the
+// nursery is emptied and the roots are rescanned
+void Heap::finish_marking() {
+  if (young_top != young_begin) {
+    minor_collect();
+  }
+  mark_roots();
+  trace();
+  start_sweep();
+}
+
+// stale young objects are left to the minor collections
+void Heap::mark(Object *obj) {
+  if (obj != nullptr && obj->gc_mark != epoch && !is_young(obj)) {
+    obj->gc_mark = epoch;
+    gray_objects.push_back(obj);
+  }
+}
+
+void Heap::mark(Func *func) {
+  if (func != nullptr && func->gc_mark != epoch) {
+    func->gc_mark = epoch;
+    gray_funcs.push_back(func);
+  }
+}
+
+void Heap::mark(const Value &value) {
+  if (value.type == Type::OBJECT) {
+    mark(value.objval);
+  } else if (value.type == Type::FUNCTION) {
+    mark(value.funcval);
+  }
+}
+
+// functions and objects referred from instructions
+void Heap::mark(const CodeSequence &codes) {
+  size_t pc = 0;
+  while (pc < codes.size()) {
+    Instruction op = codes.at(pc).op;
+    switch (op) {
+    case Instruction::PUT_LAMBDA:
+    case Instruction::CALL_DIRECT:
+      mark(codes.at(pc + 1).funcval);
+      break;
+    case Instruction::DEF_FUNC:
+      mark((Func *)codes.at(pc + 2).objval);
+      break;
+    case Instruction::PUT_OBJECT:
+      mark(codes.at(pc + 1).objval);
+      break;
+    default:
+      break;
+    }
+    pc += 1 + operand_count(op);
+  }
+}
+
+void Heap::trace() { trace_some(SIZE_MAX); }
+
+// true when nothing is left gray
+bool Heap::trace_some(size_t budget) {
+  for (; budget > 0; budget--) {
+    if (gray_objects.empty() && gray_funcs.empty()) {
+      return true;
+    }
+    if (!gray_objects.empty()) {
+      Object *obj = gray_objects.back();
+      gray_objects.pop_back();
+      mark(obj->klass);
+      if (obj->methods != nullptr) {
+        for (const auto &method : *obj->methods) {
+          mark(method.second);
+        }
+      }
+      for (const auto &field : obj->fields) {
+        mark(field.second);
+      }
+      obj->trace(*this);
+    } else {
+      Func *func = gray_funcs.back();
+      gray_funcs.pop_back();
+      if (func->body != nullptr) {
+        mark(*func->body);
+      }
+      if (func->lazy != nullptr) {
+        func->lazy->trace(*this);
+      }
+    }
+  }
+  return gray_objects.empty() && gray_funcs.empty();
+}
+
+void Heap::sweep() {
+  start_sweep();
+  sweep_some(SIZE_MAX);
+  finish_sweep();
+}
+
+// cells made from here on are appended past the sweep ends and survive
+void Heap::start_sweep() {
+  phase = Phase::Sweeping;
+  swept_objects = swept_funcs = 0;
+  sweep_objects_end = objects.size();
+  sweep_funcs_end = funcs.size();
+}
+
+// dead cells are freed and their entries cleared; true when done
+bool Heap::sweep_some(size_t budget) {
+  for (; budget > 0 && swept_objects < sweep_objects_end; budget--) {
+    auto &cell = objects[swept_objects++];
+    if (cell.first->gc_mark != epoch) {
+      bytes -= cell.second;
+      delete cell.first;
+      cell.first = nullptr;
+      freed++;
+    }
+  }
+  for (; budget > 0 && swept_funcs < sweep_funcs_end; budget--) {
+    auto &cell = funcs[swept_funcs++];
+    if (cell.first->gc_mark != epoch) {
+      bytes -= cell.second;
+      delete cell.first;
+      cell.first = nullptr;
+      freed++;
+    }
+  }
+  return swept_objects == sweep_objects_end &&
+         swept_funcs == sweep_funcs_end;
+}
+
+void Heap::finish_sweep() {
+  objects.erase(remove_if(objects.begin(), objects.end(),
+                          [](const pair<Object *, size_t> &cell) {
+                            return cell.first == nullptr;
+                          }),
+                objects.end());
+  funcs.erase(remove_if(funcs.begin(), funcs.end(),
+                        [](const pair<Func *, size_t> &cell) {
+                          return cell.first == nullptr;
+                        }),
+              funcs.end());
+  phase = Phase::Idle;
+
+  next_gc = max(bytes * 2, (size_t)initial_threshold);
+  if (limit != 0) {
+    next_gc = min(next_gc, limit);
+  }
+}
+
+// nearest-rank percentiles of the pauses in milliseconds
+static void print_pauses(ostream &out, vector<double> pauses) {
+  if (pauses.empty()) {
+    out << "no pauses" << endl;
+    return;
+  }
+  sort(pauses.begin(), pauses.end());
+  auto percentile = [&](double p) {
+    size_t rank = (size_t)ceil(p * pauses.size());
+    return pauses[max(rank, (size_t)1) - 1];
+  };
+  out << pauses.size() << " pauses, p50 " << percentile(0.5) << " ms, p99 "
+      << percentile(0.99) << " ms, max " << pauses.back() << " ms, total "
+      << accumulate(pauses.begin(), pauses.end(), 0.0) << " ms" << endl;
+}
+
+void Heap::print_stats(ostream &out) const {
+  out << fixed << setprecision(3);
+  out << "gc: " << minor_collections << " minor collections in ";
+  print_pauses(out, minor_pauses);
+  out << "gc: " << collections << " major collections in ";
+  print_pauses(out, pauses);
+  out << "gc: " << freed << " cells freed, " << promoted << " promoted, "
+      << bytes << " old bytes live, " << peak_bytes << " old bytes peak"
+      << endl;
+  out << "gc: " << slabs.slab_bytes() << " bytes in slabs, "
+      << slabs.live_bytes() << " in live cells" << endl;
+}
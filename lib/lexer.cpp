@@ -1,32 +1,60 @@
 #include "holang/lexer.hpp"
+#include "holang/exception.hpp"
+#include "holang/scan.hpp"
+#include <algorithm>
+#include <cstring>
 #include <iostream>
-#include <map>
-#include <string>
-#include <vector>
+#include <mutex>
 
 using namespace std;
 using namespace holang;
 
-map<string, TokenType> Lexer::keywords;
+Lexer::Keyword Lexer::keywords[keyword_slots];
 
+// the hash is perfect on these words, init_keywords checks it
+size_t Lexer::keyword_hash(const char *word, size_t length) {
+  return ((uint8_t)word[0] * 2 + (uint8_t)word[length - 1] * 6 + length) &
+         (keyword_slots - 1);
+}
+
+// lexers may be made on several threads at once
 void Lexer::init_keywords() {
-  if (!Lexer::keywords.empty()) {
-    return;
-  }
+  static once_flag once;
+  call_once(once, [] {
+    const Keyword words[] = {
+        {"true", 4, TokenType::True},     {"false", 5, TokenType::False},
+        {"if", 2, TokenType::If},         {"else", 4, TokenType::Else},
+        {"func", 4, TokenType::Func},     {"class", 5, TokenType::Class},
+        {"import", 6, TokenType::Import}, {"while", 5, TokenType::While},
+        {"return", 6, TokenType::Return}, {"sealed", 6, TokenType::Sealed},
+        {"try", 3, TokenType::Try},       {"catch", 5, TokenType::Catch},
+        {"raise", 5, TokenType::Raise},   {"case", 4, TokenType::Case},
+        {"when", 4, TokenType::When},
+    };
+    for (const auto &word : words) {
+      Keyword &slot = keywords[keyword_hash(word.word, word.length)];
+      if (slot.length != 0) {
+        cerr << "keyword hash collision: " << word.word << endl;
+        abort();
+      }
+      slot = word;
+    }
+  });
+}
 
-  keywords["true"] = TokenType::True;
-  keywords["false"] = TokenType::False;
-  keywords["if"] = TokenType::If;
-  keywords["else"] = TokenType::Else;
-  keywords["func"] = TokenType::Func;
-  keywords["class"] = TokenType::Class;
-  keywords["import"] = TokenType::Import;
-  keywords["while"] = TokenType::While;
-  keywords["return"] = TokenType::Return;
+TokenType Lexer::keyword_or_ident(const char *word, size_t length) {
+  if (length < min_keyword || length > max_keyword) {
+    return TokenType::Ident;
+  }
+  const Keyword &keyword = keywords[keyword_hash(word, length)];
+  if (keyword.length == length && memcmp(keyword.word, word, length) == 0) {
+    return keyword.type;
+  }
+  return TokenType::Ident;
 }
 
 bool Lexer::is_next(char c) {
-  if (code_str[head] == c) {
+  if (code[head] == c) {
     head++;
     return true;
   } else {
@@ -34,26 +62,14 @@ bool Lexer::is_next(char c) {
   }
 }
 
-char Lexer::nextc() const { return code_str[head]; }
+char Lexer::nextc() const { return code[head]; }
 
-char Lexer::readc() { return code_str[head++]; }
+char Lexer::readc() { return code[head++]; }
 
 void Lexer::unreadc() { head--; }
 
-Token *make_integer(const string &sval) {
-  uint64_t i = stoi(sval);
-  return new Token(i);
-}
-
-Token *make_double(const string &sval) {
-  double d = stod(sval);
-  return new Token(d);
-}
-
-Token *make_token(TokenType type) { return new Token(type); }
-
-Token *Lexer::read_number(char c) {
-  string sval(1, c);
+// the value is read by the parser from the text of the token
+TokenType Lexer::read_number() {
   bool has_dot = false;
   while (true) {
     char c = readc();
@@ -64,85 +80,66 @@ Token *Lexer::read_number(char c) {
       }
       char nc = readc();
       if (isdigit(nc)) {
-        sval.push_back('.');
-        sval.push_back(nc);
         has_dot = true;
       } else {
         unreadc();
         unreadc();
         break;
       }
-    } else if (isdigit(c)) {
-      sval.push_back(c);
-    } else {
+    } else if (!isdigit(c)) {
       unreadc();
       break;
     }
   }
-
-  if (has_dot) {
-    return make_double(sval);
-  } else {
-    return make_integer(sval);
-  }
+  return has_dot ? TokenType::Double : TokenType::Integer;
 }
 
-Token *make_ident(const string &ident) {
-  return new Token(TokenType::Ident, ident);
-}
-
-Token *Lexer::read_ident(char c) {
-  string sval(1, c);
-  while (true) {
-    char c = readc();
-    if (!(isalnum(c) || c == '_')) {
-      unreadc();
-      auto k = keywords.find(sval);
-      if (k != keywords.end())
-        return make_token(k->second);
-      else
-        return make_ident(sval);
-    }
-    sval.push_back(c);
-  }
+TokenType Lexer::read_ident() {
+  head = scan::skip_ident(code + head) - code;
+  return keyword_or_ident(code + token_begin_at, head - token_begin_at);
 }
 
-Token *make_str(const string &str) { return new Token(TokenType::String, str); }
-
-Token *Lexer::read_str() {
-  string str = "";
+TokenType Lexer::read_str() {
   while (true) {
+    head = scan::find_quote(code + head) - code;
     char c = readc();
     if (c == '"') {
-      break;
+      return TokenType::String;
+    }
+    if (head > code_size) {
+      throw SyntaxError("unterminated string at line " + to_string(line) +
+                        ", col " +
+                        to_string(token_begin_at - line_begin_at + 1));
     }
-    str.push_back(c);
   }
-  return make_str(str);
 }
 
-Token *make_eof() { return new Token(TokenType::TEOF); }
-
-Token *make_newline() { return new Token(TokenType::NewLine); }
-
 void Lexer::invalid(char c) const {
-  cerr << "unexpected character: " << c;
-  cerr << " at line " << line << ", col " << head - line_begin_at << endl;
-  exit(1);
+  throw SyntaxError(string("unexpected character: ") + c + " at line " +
+                    to_string(line) + ", col " +
+                    to_string(head - line_begin_at));
 }
 
 bool isblank(char c) { return c == ' ' || c == '\t'; }
 
+// mostly a single space, too short for a vector
 void Lexer::skip_blank() {
-  char c = readc();
-  while (isblank(c)) {
-    c = readc();
+  while (isblank(code[head])) {
+    head++;
   }
-  unreadc();
 }
 
 void Lexer::skip_to_newline() {
-  while (readc() != '\n') {
+  while (true) {
+    head = scan::find_newline(code + head) - code;
+    char c = readc();
+    if (c == '\n') {
+      break;
+    }
+    if (head > code_size) {
+      unreadc(); // a comment on the last line
+      return;
+    }
   }
   line++;
   line_begin_at = head;
@@ -164,131 +161,138 @@ void Lexer::skip_blank_lines() {
   unreadc();
 }
 
-Token *Lexer::take_token() {
+TokenType Lexer::take_token() {
   skip_blank();
 
   token_begin_at = head;
   char c = readc();
   switch (c) {
   case '0' ... '9':
-    return read_number(c);
+    return read_number();
   case '"':
     return read_str();
   case '+':
     if (is_next('+')) {
-      return make_token(TokenType::PlusPlus);
+      return TokenType::PlusPlus;
     } else if (is_next('=')) {
-      return make_token(TokenType::PlusAssign);
+      return TokenType::PlusAssign;
     } else {
-      return make_token(TokenType::Plus);
+      return TokenType::Plus;
     }
   case '-':
     if (is_next('-')) {
-      return make_token(TokenType::MinusMinus);
+      return TokenType::MinusMinus;
     } else if (is_next('=')) {
-      return make_token(TokenType::MinusAssign);
+      return TokenType::MinusAssign;
     } else {
-      return make_token(TokenType::Minus);
+      return TokenType::Minus;
     }
   case '*':
     if (is_next('*')) {
       invalid(c);
     } else if (is_next('=')) {
-      return make_token(TokenType::MulAssign);
+      return TokenType::MulAssign;
     } else {
-      return make_token(TokenType::Mul);
+      return TokenType::Mul;
     }
   case '/':
     if (is_next('/')) {
       invalid(c);
     } else if (is_next('=')) {
-      return make_token(TokenType::DivAssign);
+      return TokenType::DivAssign;
     } else {
-      return make_token(TokenType::Div);
+      return TokenType::Div;
     }
   case '%':
-    return make_token(TokenType::Mod);
+    return TokenType::Mod;
   case '<':
     if (is_next('=')) {
-      return make_token(TokenType::LessEqualThan);
+      return TokenType::LessEqualThan;
     } else {
-      return make_token(TokenType::LessThan);
+      return TokenType::LessThan;
     }
   case '>':
     if (is_next('=')) {
-      return make_token(TokenType::GreaterEqualThan);
+      return TokenType::GreaterEqualThan;
     } else {
-      return make_token(TokenType::GreaterThan);
+      return TokenType::GreaterThan;
     }
   case '=':
     if (is_next('=')) {
-      return make_token(TokenType::Equal);
+      return TokenType::Equal;
     } else {
-      return make_token(TokenType::Assign);
+      return TokenType::Assign;
     }
   case '!':
     if (is_next('=')) {
-      return make_token(TokenType::NotEqual);
+      return TokenType::NotEqual;
     } else {
-      return make_token(TokenType::Not);
+      return TokenType::Not;
     }
   case '(':
-    return make_token(TokenType::ParenL);
+    return TokenType::ParenL;
   case ')':
-    return make_token(TokenType::ParenR);
+    return TokenType::ParenR;
   case '{':
-    return make_token(TokenType::BraseL);
+    return TokenType::BraseL;
   case '}':
-    return make_token(TokenType::BraseR);
+    return TokenType::BraseR;
   case '[':
-    return make_token(TokenType::BracketL);
+    return TokenType::BracketL;
   case ']':
-    return make_token(TokenType::BracketR);
+    return TokenType::BracketR;
   case ',':
-    return make_token(TokenType::Comma);
+    return TokenType::Comma;
   case '.':
-    return make_token(TokenType::Dot);
+    return TokenType::Dot;
   case '|':
     if (is_next('|')) {
-      return make_token(TokenType::OR);
+      return TokenType::OR;
     } else {
-      return make_token(TokenType::VertialBar);
+      return TokenType::VertialBar;
     }
   case '&':
     if (is_next('&')) {
-      return make_token(TokenType::AND);
+      return TokenType::AND;
     } else {
-      return make_token(TokenType::Anpersand);
+      return TokenType::Anpersand;
     }
   case '\n':
     line++;
     line_begin_at = head;
     skip_blank_lines();
-    return make_newline();
+    return TokenType::NewLine;
   case '#':
     skip_to_newline();
     skip_blank_lines();
-    return make_newline();
+    return TokenType::NewLine;
   case '\0':
-    return make_eof();
+    return TokenType::TEOF;
   case 'a' ... 'z':
   case 'A' ... 'Z':
   case '_':
-    return read_ident(c);
+    return read_ident();
   default:
     invalid(c);
-    return nullptr;
+    return TokenType::TEOF;
   }
 }
 
-void Lexer::lex(vector<Token *> &token_chain) {
-  line = 1;
-  head = 0;
+Token Lexer::next() {
+  TokenType type = head > code_size ? TokenType::TEOF : take_token();
+  size_t end = min(head, code_size); // EOF is empty
+  return Token{type, (uint32_t)(end - token_begin_at), (int)line,
+               (int)(token_begin_at - line_begin_at + 1),
+               code + token_begin_at};
+}
 
-  while (head <= code_str.size()) {
-    Token *token = take_token();
-    token->line = line;
-    token->column = token_begin_at - line_begin_at + 1;
-    token_chain.push_back(token);
-  }
+void Lexer::lex(TokenBuffer &tokens) {
+  // code has about a token per 4 bytes; this spares growing five arrays
+  tokens.reserve(code_size / 4);
+
+  Token token;
+  do {
+    token = next();
+    tokens.push(token);
+  } while (token.type != TokenType::TEOF);
 }
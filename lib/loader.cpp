@@ -0,0 +1,256 @@
+#include "holang/loader.hpp"
+#include "config.hpp"
+#include "holang/exception.hpp"
+#include "holang/lexer.hpp"
+#include "holang/optimizer.hpp"
+#include "holang/parser.hpp"
+#include "holang/source.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <unistd.h>
+
+using namespace std;
+using namespace holang;
+
+const unsigned ModuleLoader::max_workers;
+
+namespace {
+bool real_path(const string &path, string *real) {
+  char *resolved = realpath(path.c_str(), nullptr);
+  if (resolved == nullptr) {
+    return false;
+  }
+  *real = resolved;
+  free(resolved);
+  return true;
+}
+} // namespace
+
+#ifdef PATH_HOLIB
+const vector<string> ModuleLoader::search_path = {PATH_HOLIB};
+#else
+const vector<string> ModuleLoader::search_path = {"/"};
+#endif
+
+// one core is left to the thread that runs the program, which generates
+// code meanwhile; with a single core nothing is preloaded
+unsigned ModuleLoader::default_workers() {
+  unsigned cores = thread::hardware_concurrency();
+  return cores > 1 ? min(cores - 1, max_workers) : 0;
+}
+
+shared_ptr<const Bundle> &ModuleLoader::bundled() {
+  static shared_ptr<const Bundle> bundle;
+  return bundle;
+}
+
+ModuleLoader::~ModuleLoader() {
+  {
+    lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  queued.notify_all();
+  for (thread &worker : workers) {
+    worker.join();
+  }
+}
+
+// Loader threads resolve the imports of the modules they parse, so the
+// paths found are shared under a lock. Targets not found are looked up
+// again, they may be created meanwhile.
+string ModuleLoader::resolve(const string &target) {
+  string path;
+  if (bundled() != nullptr && bundled()->resolve(target, &path)) {
+    return path;
+  }
+  static std::mutex mutex;
+  static unordered_map<string, string> resolved;
+  {
+    lock_guard<std::mutex> lock(mutex);
+    auto it = resolved.find(target);
+    if (it != resolved.end()) {
+      return it->second;
+    }
+  }
+
+  path = target;
+  if (target.front() != '.') {
+    for (const auto &prefix : search_path) {
+      string candidate = prefix + '/' + target;
+      if (access(candidate.c_str(), R_OK) == 0) {
+        path = candidate;
+        break;
+      }
+    }
+  }
+  if (!real_path(path, &path)) {
+    return target;
+  }
+  lock_guard<std::mutex> lock(mutex);
+  return resolved.emplace(target, path).first->second;
+}
+
+string ModuleLoader::canonical(const string &path) {
+  string canonical_path;
+  return real_path(path, &canonical_path) ? canonical_path : path;
+}
+
+unique_ptr<ParsedModule> ModuleLoader::parse(const string &path,
+                                             bool cached) {
+  unique_ptr<ParsedModule> module(new ParsedModule);
+  if (bundled() != nullptr && cached) {
+    module->bytecode = bundled()->module(path);
+    if (module->bytecode != nullptr) {
+      module->imports = module->bytecode->imports();
+      return module;
+    }
+  }
+  SourceFile source(path);
+  if (source.fail()) {
+    return nullptr;
+  }
+  module->source_size = source.size();
+  if (Bytecode::enabled()) {
+    module->source_hash = Bytecode::hash(source.data(), source.size());
+  }
+  if (Bytecode::enabled() && cached) {
+    module->bytecode = Bytecode::load(module->source_hash, source.size());
+    if (module->bytecode != nullptr) {
+      module->imports = module->bytecode->imports();
+      return module;
+    }
+  }
+  Lexer lexer(source.data(), source.size());
+  TokenStream tokens(lexer);
+  Parser parser(tokens, module->arena);
+  module->root = parser.parse();
+  module->local_size = parser.toplevel_val_size();
+  module->imports = parser.imports();
+  return module;
+}
+
+void ModuleLoader::compile(unique_ptr<ParsedModule> module,
+                           CodeSequence &codes) {
+  if (module->bytecode != nullptr) {
+    if (module->bytecode->instantiate(codes)) {
+      return;
+    }
+    // a broken entry is a miss: compiled again, and replaced
+    module->bytecode->drop();
+    module = parse(codes.source_path, false);
+    if (module == nullptr) {
+      raise_error(codes.source_path + ": Not found.");
+    }
+  }
+  shared_ptr<ParsedModule> tree = move(module);
+  {
+    LazyScope scope(tree);
+    if (tree->root != nullptr) {
+      tree->root->code_gen(&codes);
+    }
+  }
+  codes.set_local_size(tree->local_size);
+  codes.append(Instruction::RET);
+  LoopOptimizer(&codes).optimize();
+  Bytecode::save(codes, tree->source_hash, tree->source_size, tree->imports);
+}
+
+void ModuleLoader::preload(const vector<string> &targets) {
+  if (targets.empty()) {
+    return;
+  }
+  // counting the cores reads a file, which programs without imports skip
+  if (!workers_set) {
+    set_workers(default_workers());
+  }
+  if (n_workers == 0) {
+    return;
+  }
+  vector<string> paths;
+  for (const auto &target : targets) {
+    paths.push_back(resolve(target));
+  }
+  lock_guard<std::mutex> lock(mutex);
+  for (const auto &path : paths) {
+    enqueue(path);
+  }
+  while (workers.size() < n_workers) {
+    workers.emplace_back(&ModuleLoader::work, this);
+  }
+}
+
+void ModuleLoader::prepare(const vector<string> &paths) {
+  for (const auto &target : paths) {
+    string path = resolve(target);
+    unique_ptr<ParsedModule> module;
+    try {
+      module = parse(path);
+    } catch (const SyntaxError &) {
+      continue; // reported by the import
+    }
+    lock_guard<std::mutex> lock(mutex);
+    Entry &entry = modules[path];
+    entry.module = move(module);
+    entry.state = State::done;
+  }
+}
+
+void ModuleLoader::enqueue(const string &path) {
+  if (modules.emplace(path, Entry()).second) {
+    queue.push_back(path);
+    queued.notify_one();
+  }
+}
+
+unique_ptr<ParsedModule> ModuleLoader::take(const string &path) {
+  unique_lock<std::mutex> lock(mutex);
+  auto it = modules.find(path);
+  if (it == modules.end()) {
+    return nullptr;
+  }
+  Entry &entry = it->second;
+  if (entry.state == State::queued) {
+    // parsing it on this thread beats waiting for the ones ahead of it
+    queue.erase(find(queue.begin(), queue.end(), path));
+    entry.state = State::done;
+    return nullptr;
+  }
+  parsed.wait(lock, [&entry] { return entry.state == State::done; });
+  return move(entry.module);
+}
+
+void ModuleLoader::work() {
+  unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    queued.wait(lock, [this] { return stopping || !queue.empty(); });
+    if (stopping) {
+      return;
+    }
+    string path = move(queue.front());
+    queue.pop_front();
+    Entry &entry = modules[path];
+    entry.state = State::parsing;
+    lock.unlock();
+
+    unique_ptr<ParsedModule> module;
+    vector<string> imports;
+    try {
+      module = parse(path);
+    } catch (const SyntaxError &) {
+      // left for the import to report
+    }
+    if (module != nullptr) {
+      for (const auto &target : module->imports) {
+        imports.push_back(resolve(target));
+      }
+    }
+
+    lock.lock();
+    for (const auto &import : imports) {
+      enqueue(import);
+    }
+    entry.module = move(module);
+    entry.state = State::done;
+    parsed.notify_all();
+  }
+}
@@ -10,7 +10,7 @@ void BinopNode::print(int offset) {
   rhs->print(offset + 1);
 }
 
-Instruction to_opcode(TokenType c) {
+Instruction holang::to_opcode(TokenType c) {
   switch (c) {
   case TokenType::Plus:
     return Instruction::ADD;
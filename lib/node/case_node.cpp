@@ -0,0 +1,100 @@
+#include "holang/node.hpp"
+#include <map>
+
+using namespace std;
+using namespace holang;
+
+void CaseNode::print(int offset) {
+  print_offset(offset);
+  cout << "case" << endl;
+  subject->print(offset + 1);
+
+  for (const auto &when : whens) {
+    print_offset(offset);
+    cout << "when";
+    for (int key : when.ints) {
+      cout << " " << key;
+    }
+    for (const auto &key : when.strings) {
+      cout << " \"" << key << "\"";
+    }
+    cout << endl;
+    if (when.body != nullptr) {
+      when.body->print(offset + 1);
+    }
+  }
+
+  if (els != nullptr) {
+    print_offset(offset);
+    cout << "else" << endl;
+    els->print(offset + 1);
+  }
+}
+
+// at least half of the table is filled by keys
+static bool is_dense(const map<int, int> &ints) {
+  long long range = (long long)ints.rbegin()->first - ints.begin()->first + 1;
+  return range <= 2 * (long long)ints.size();
+}
+
+void CaseNode::code_gen(CodeSequence *codes) {
+  subject->code_gen(codes);
+
+  // key -> index of the when, keys are unique by the parser
+  map<int, int> ints;
+  map<string, int> strings;
+  for (size_t i = 0; i < whens.size(); i++) {
+    for (int key : whens[i].ints) {
+      ints.emplace(key, i);
+    }
+    for (const auto &key : whens[i].strings) {
+      strings.emplace(key, i);
+    }
+  }
+
+  Instruction op = Instruction::LOOKUP_SWITCH;
+  if (!strings.empty()) {
+    op = Instruction::HASH_SWITCH;
+  } else if (!ints.empty() && is_dense(ints)) {
+    op = Instruction::TABLE_SWITCH;
+  }
+  codes->append(op);
+  int from_switch = codes->size();
+  codes->append(0); // dummy
+
+  vector<int> to_whens, from_whens;
+  for (const auto &when : whens) {
+    to_whens.push_back(codes->size());
+    gen_suite(when.body, codes);
+    from_whens.push_back(codes->size() + 1);
+    codes->append(Instruction::JUMP);
+    codes->append(0); // dummy
+  }
+
+  int to_else = codes->size();
+  gen_suite(els, codes);
+  int to_end = codes->size();
+  for (int from : from_whens) {
+    codes->at(from).ival = to_end;
+  }
+
+  CodeSequence::Switch table;
+  table.otherwise = to_else;
+  if (op == Instruction::TABLE_SWITCH) {
+    table.low = ints.begin()->first;
+    table.targets.assign(ints.rbegin()->first - table.low + 1, to_else);
+    for (const auto &key : ints) {
+      table.targets[key.first - table.low] = to_whens[key.second];
+    }
+  } else {
+    for (const auto &key : ints) {
+      table.keys.push_back(key.first);
+      table.targets.push_back(to_whens[key.second]);
+    }
+    for (const auto &key : strings) {
+      table.strings[key.first] = table.targets.size();
+      table.targets.push_back(to_whens[key.second]);
+    }
+  }
+  codes->at(from_switch).ival = codes->add_switch(table);
+}
@@ -5,15 +5,26 @@ using namespace holang;
 
 void KlassDefNode::print(int offset) {
   print_offset(offset);
-  cout << "KlassDef " << name << endl;
-  body->print(offset + 1);
+  cout << "KlassDef " << name;
+  if (!superclass.empty()) {
+    cout << " < " << superclass;
+  }
+  cout << endl;
+  if (body != nullptr) {
+    body->print(offset + 1);
+  }
 }
 
 void KlassDefNode::code_gen(CodeSequence *codes) {
   codes->append(Instruction::LOAD_CLASS);
-  codes->append(&name);
+  codes->append(CodeSequence::intern(name));
+  codes->append(superclass.empty() ? nullptr
+                                   : CodeSequence::intern(superclass));
 
-  body->code_gen(codes);
+  // an empty body only defines the class
+  if (body != nullptr) {
+    body->code_gen(codes);
+  }
 
   codes->append(Instruction::PREV_ENV);
 }
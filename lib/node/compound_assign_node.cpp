@@ -0,0 +1,29 @@
+#include "holang/node.hpp"
+
+using namespace std;
+using namespace holang;
+
+void CompoundAssignNode::print(int offset) {
+  print_offset(offset);
+  cout << "CompoundAssign " << op << " " << lhs->ident << " : " << lhs->index
+       << endl;
+  rhs->print(offset + 1);
+}
+
+void CompoundAssignNode::code_gen(CodeSequence *codes) {
+  auto *literal = dynamic_cast<IntLiteralNode *>(rhs);
+  if (literal != nullptr && (op == TokenType::Plus || op == TokenType::Minus)) {
+    codes->append(op == TokenType::Plus ? Instruction::ADD_LOCAL_CONST
+                                        : Instruction::SUB_LOCAL_CONST);
+    codes->append(lhs->index);
+    codes->append(literal->get_value());
+    return;
+  }
+
+  codes->append(Instruction::LOAD_LOCAL);
+  codes->append(lhs->index);
+  rhs->code_gen(codes);
+  codes->append(to_opcode(op));
+  codes->append(Instruction::STORE_LOCAL);
+  codes->append(lhs->index);
+}
@@ -5,7 +5,7 @@ using namespace holang;
 
 void FuncCallNode::print(int offset) {
   print_offset(offset);
-  cout << "Call " << name << endl;
+  cout << "Call " << name << (callee != nullptr ? " direct" : "") << endl;
   for (const auto &arg : args) {
     arg->print(offset + 1);
   }
@@ -19,7 +19,12 @@ void FuncCallNode::code_gen(CodeSequence *codes) {
   for (Node *arg : args) {
     arg->code_gen(codes);
   }
-  codes->append(Instruction::CALL_FUNC);
-  codes->append(&name);
+  if (callee != nullptr) {
+    codes->append(Instruction::CALL_DIRECT);
+    codes->append(callee->get_func());
+  } else {
+    codes->append(Instruction::CALL_FUNC);
+    codes->append((int)Selectors::of(name));
+  }
   codes->append((int)args.size());
 }
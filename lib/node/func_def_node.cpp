@@ -1,21 +1,99 @@
+#include "holang/heap.hpp"
 #include "holang/node.hpp"
+#include "holang/optimizer.hpp"
 
 using namespace std;
 using namespace holang;
 
+shared_ptr<const void> LazyScope::current;
+
+namespace {
+shared_ptr<const CodeSequence> generate(Node *body, int local_size,
+                                        const string &source_path) {
+  auto body_code = make_shared<CodeSequence>(source_path);
+  gen_suite(body, body_code.get());
+  body_code->append(Instruction::RET);
+  body_code->set_local_size(local_size);
+  LoopOptimizer(body_code.get()).optimize();
+  return body_code;
+}
+
+// A body left for the first call. Until then it keeps its syntax tree, and
+// the sealed functions its code will call directly, alive.
+class FuncBody : public LazyBody {
+public:
+  FuncBody(Node *body, int local_size, const vector<Func *> &callees,
+           const string &source_path)
+      : body(body), local_size(local_size), callees(callees),
+        source_path(source_path), tree(LazyScope::tree()) {}
+
+  // copies of a function share the code
+  shared_ptr<const CodeSequence> compile() override {
+    if (code == nullptr) {
+      Heap::get().pause();
+      {
+        LazyScope scope(tree);
+        code = generate(body, local_size, source_path);
+      }
+      Heap::get().resume();
+      callees.clear();
+      tree.reset();
+    }
+    return code;
+  }
+
+  void trace(Heap &heap) override {
+    for (Func *callee : callees) {
+      heap.mark(callee);
+    }
+  }
+
+private:
+  Node *body;
+  int local_size;
+  vector<Func *> callees;
+  const string &source_path; // interned
+  shared_ptr<const void> tree;
+  shared_ptr<const CodeSequence> code;
+};
+} // namespace
+
+void holang::gen_func_body(Func *func, Node *body, int local_size,
+                           const vector<FuncDefNode *> &callees,
+                           const string &source_path) {
+  if (LazyScope::tree() == nullptr) {
+    func->body = generate(body, local_size, source_path);
+    return;
+  }
+  vector<Func *> callee_funcs;
+  for (FuncDefNode *callee : callees) {
+    callee_funcs.push_back(callee->get_func());
+  }
+  func->lazy =
+      make_shared<FuncBody>(body, local_size, callee_funcs, source_path);
+}
+
 void FuncDefNode::print(int offset) {
   print_offset(offset);
-  cout << "FuncDef " << name << endl;
-  body->print(offset + 1);
+  cout << "FuncDef " << name << (is_sealed ? " sealed" : "") << endl;
+  if (body != nullptr) {
+    body->print(offset + 1);
+  }
 }
 
-void FuncDefNode::code_gen(CodeSequence *codes) {
-  CodeSequence body_code(codes->source_path);
+Func *FuncDefNode::get_func() {
+  if (func == nullptr) {
+    func = Heap::get().make<Func>();
+    func->sealed = is_sealed;
+  }
+  return func;
+}
 
-  body->code_gen(&body_code);
-  body_code.append(Instruction::RET);
+void FuncDefNode::code_gen(CodeSequence *codes) {
+  Func *func = get_func();
+  gen_func_body(func, body, local_size, callees, codes->source_path);
 
   codes->append(Instruction::DEF_FUNC);
-  codes->append(&name);
-  codes->append((Object *)new Func(body_code));
+  codes->append((int)Selectors::of(name));
+  codes->append((Object *)func);
 }
@@ -10,7 +10,9 @@ void IfNode::print(int offset) {
 
   print_offset(offset);
   cout << "then " << endl;
-  then->print(offset + 1);
+  if (then != nullptr) {
+    then->print(offset + 1);
+  }
 
   if (els != nullptr) {
     print_offset(offset);
@@ -25,7 +27,7 @@ void IfNode::code_gen(CodeSequence *codes) {
   int from_if = codes->size() + 1;
   codes->append(Instruction::JUMP_IFNOT);
   codes->append(0); // dummy
-  then->code_gen(codes);
+  gen_suite(then, codes);
 
   int from_then = codes->size() + 1;
   codes->append(Instruction::JUMP);
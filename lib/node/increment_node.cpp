@@ -0,0 +1,27 @@
+#include "holang/node.hpp"
+
+using namespace std;
+using namespace holang;
+
+void IncrementNode::print(int offset) {
+  print_offset(offset);
+  cout << (is_prefix ? "PreIncrement " : "PostIncrement ") << amount << " "
+       << ident->ident << " : " << ident->index << endl;
+}
+
+void IncrementNode::code_gen(CodeSequence *codes) {
+  if (!is_prefix) {
+    codes->append(Instruction::LOAD_LOCAL);
+    codes->append(ident->index);
+  }
+  // -- subtracts, so that on a non-integer it fails as - does
+  if (amount < 0) {
+    codes->append(is_prefix ? Instruction::SUB_LOCAL_CONST
+                            : Instruction::DEC_LOCAL);
+  } else {
+    codes->append(is_prefix ? Instruction::ADD_LOCAL_CONST
+                            : Instruction::INC_LOCAL);
+  }
+  codes->append(ident->index);
+  codes->append(amount < 0 ? -amount : amount);
+}
@@ -1,3 +1,4 @@
+#include "holang/heap.hpp"
 #include "holang/node.hpp"
 
 using namespace std;
@@ -6,15 +7,15 @@ using namespace holang;
 void LambdaNode::print(int offset) {
   print_offset(offset);
   cout << "Lambda" << endl;
-  body->print(offset + 1);
+  if (body != nullptr) {
+    body->print(offset + 1);
+  }
 }
 
 void LambdaNode::code_gen(CodeSequence *codes) {
-  CodeSequence body_code(codes->source_path);
-
-  body->code_gen(&body_code);
-  body_code.append(Instruction::RET);
+  Func *func = Heap::get().make<Func>();
+  gen_func_body(func, body, local_size, callees, codes->source_path);
 
   codes->append(Instruction::PUT_LAMBDA);
-  codes->append(new Func(body_code));
+  codes->append(func);
 }
@@ -0,0 +1,15 @@
+#include "holang/node.hpp"
+
+using namespace std;
+using namespace holang;
+
+void RaiseNode::print(int offset) {
+  print_offset(offset);
+  cout << "Raise" << endl;
+  expr->print(offset + 1);
+}
+
+void RaiseNode::code_gen(CodeSequence *codes) {
+  expr->code_gen(codes);
+  codes->append(Instruction::RAISE);
+}
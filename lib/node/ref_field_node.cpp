@@ -10,5 +10,5 @@ void RefFieldNode::print(int offset) {
 
 void RefFieldNode::code_gen(CodeSequence *codes) {
   codes->append(Instruction::LOAD_OBJ_FIELD);
-  codes->append(&field);
+  codes->append(CodeSequence::intern(field));
 }
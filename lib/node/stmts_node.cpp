@@ -3,6 +3,16 @@
 using namespace std;
 using namespace holang;
 
+void holang::gen_suite(Node *suite, CodeSequence *codes) {
+  if (suite == nullptr) {
+    // nilの概念ができたらnilにする
+    codes->append(Instruction::PUT_INT);
+    codes->append(0);
+  } else {
+    suite->code_gen(codes);
+  }
+}
+
 void StmtsNode::print(int offset) {
   current->print(offset);
   next->print(offset);
@@ -10,5 +10,5 @@ void StringLiteralNode::print(int offset) {
 
 void StringLiteralNode::code_gen(CodeSequence *codes) {
   codes->append(Instruction::PUT_STRING);
-  codes->append(&str);
+  codes->append(CodeSequence::intern(str));
 }
@@ -0,0 +1,37 @@
+#include "holang/node.hpp"
+
+using namespace std;
+using namespace holang;
+
+void TryNode::print(int offset) {
+  print_offset(offset);
+  cout << "try" << endl;
+  if (body != nullptr) {
+    body->print(offset + 1);
+  }
+
+  print_offset(offset);
+  cout << "catch " << ident->ident << " : " << ident->index << endl;
+  if (handler != nullptr) {
+    handler->print(offset + 1);
+  }
+}
+
+void TryNode::code_gen(CodeSequence *codes) {
+  int begin = codes->size();
+  gen_suite(body, codes);
+
+  int from_body = codes->size() + 1;
+  codes->append(Instruction::JUMP);
+  codes->append(0); // dummy
+  int end = codes->size();
+
+  int target = codes->size();
+  codes->append(Instruction::STORE_LOCAL);
+  codes->append(ident->index);
+  codes->append(Instruction::POP);
+  gen_suite(handler, codes);
+
+  codes->at(from_body).ival = codes->size();
+  codes->add_handler({begin, end, target, env});
+}
@@ -10,7 +10,9 @@ void WhileNode::print(int offset) {
 
   print_offset(offset);
   cout << "do " << endl;
-  body->print(offset + 1);
+  if (body != nullptr) {
+    body->print(offset + 1);
+  }
 }
 
 void WhileNode::code_gen(CodeSequence *codes) {
@@ -20,9 +22,14 @@ void WhileNode::code_gen(CodeSequence *codes) {
   codes->append(0); // dummy
   int from_cond = codes->size() - 1;
 
-  body->code_gen(codes);
+  gen_suite(body, codes);
+  codes->append(Instruction::POP);
   codes->append(Instruction::JUMP);
   codes->append(to_cond);
 
   codes->at(from_cond).ival = codes->size();
+
+  // nilの概念ができたらnilにする
+  codes->append(Instruction::PUT_INT);
+  codes->append(0);
 }
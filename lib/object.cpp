@@ -1,20 +1,67 @@
 #include "holang/object.hpp"
 #include "holang.hpp"
+#include "holang/exception.hpp"
+#include "holang/heap.hpp"
 
 using namespace holang;
 
-Func *Object::find_method(const std::string &method_name) {
-  auto it = methods.find(method_name);
-  if (it != methods.end()) {
-    return it->second;
-  } else if (klass != nullptr) {
-    return klass->find_method(method_name);
+void *Object::operator new(size_t size) {
+  return Heap::get().allocate_old(size);
+}
+
+void Object::operator delete(void *cell, size_t size) {
+  Heap::get().free_old(cell, size);
+}
+
+void *Func::operator new(size_t size) {
+  return Heap::get().allocate_old(size);
+}
+
+void Func::operator delete(void *cell, size_t size) {
+  Heap::get().free_old(cell, size);
+}
+
+void Func::compile() {
+  body = lazy->compile();
+  lazy.reset();
+  Heap::get().write_barrier(*body);
+}
+
+Func *Object::find_method(Selector sel) {
+  Func *func = lookup_method(sel);
+  if (func == nullptr) {
+    raise_error("method unmatch: " + Selectors::name(sel));
+  }
+  return func;
+}
+
+Func *Object::lookup_method(Selector sel) {
+  if (methods != nullptr) {
+    auto it = methods->find(sel);
+    if (it != methods->end()) {
+      return it->second;
+    }
+  }
+  if (klass != nullptr) {
+    return klass->dispatch(sel);
   } else {
-    std::cerr << "method unmatch: " << method_name << std::endl;
-    exit(1);
+    return nullptr;
   }
 }
 
+void Object::set_method(Selector sel, Func *func) {
+  Heap::get().write_barrier(func);
+  if (methods == nullptr) {
+    methods = new MethodTable;
+  }
+  (*methods)[sel] = func;
+}
+
+void Object::set_field(const std::string &name, Object *obj) {
+  Heap::get().write_barrier(this, obj);
+  fields.emplace(name, obj);
+}
+
 Object *Object::find_field(const std::string &field_name) {
   auto it = fields.find(field_name);
   if (it != fields.end()) {
@@ -22,39 +69,102 @@ Object *Object::find_field(const std::string &field_name) {
   } else if (klass != nullptr) {
     return klass->find_field(field_name);
   } else {
-    std::cerr << "Object#find_field() unmatch: " << field_name << std::endl;
-    exit(1);
+    raise_error("Object#find_field() unmatch: " + field_name);
   }
 }
 
 Klass Klass::Int{"Int"};
 Klass Klass::String{"String"};
 
+Object *Klass::new_object() {
+  auto *obj = Heap::get().make<Object>();
+  obj->klass = this;
+  return obj;
+}
+
 void Klass::init() {
   std::function<Object *(const Klass)> nnn = &Klass::new_object;
   auto self = this;
   NativeFunc func = [=](Value *, Value *, int) {
     return Value(self->new_object());
   };
-  methods["new"] = new Func(func);
+  set_method("new", Heap::get().make<Func>(func));
+}
+
+void Klass::trace(Heap &heap) {
+  heap.mark(super);
+  for (Klass *subclass : subclasses) {
+    heap.mark(subclass);
+  }
+}
+
+void Klass::set_superclass(Klass *klass) {
+  Heap::get().write_barrier(this, klass);
+  Heap::get().write_barrier(klass, this);
+  super = klass;
+  klass->subclasses.push_back(this);
+  invalidate();
+}
+
+void Klass::set_method(Selector sel, Func *func) {
+  Object::set_method(sel, func);
+  invalidate();
+}
+
+bool Klass::overridden_below(Selector sel) const {
+  for (Klass *subclass : subclasses) {
+    if ((subclass->methods != nullptr && subclass->methods->count(sel) != 0) ||
+        subclass->overridden_below(sel)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void Klass::flatten() {
+  if (super != nullptr) {
+    if (!super->table_valid) {
+      super->flatten();
+    }
+    table = super->table;
+  } else {
+    table.clear();
+  }
+  for (const auto &method : *methods) {
+    if (method.first >= table.size()) {
+      table.resize(method.first + 1, nullptr);
+    }
+    table[method.first] = method.second;
+  }
+  table_valid = true;
+}
+
+// a valid table implies valid tables above, so the walk stops at the first
+// invalid class
+void Klass::invalidate() {
+  if (!table_valid) {
+    return;
+  }
+  table_valid = false;
+  for (Klass *subclass : subclasses) {
+    subclass->invalidate();
+  }
 }
 
-Func *Value::find_method(const std::string &name) {
+Func *Value::find_method(Selector sel) {
   switch (type) {
   case Type::OBJECT:
-    return objval->find_method(name);
+    return objval->find_method(sel);
   case Type::INT:
-    return Klass::Int.find_method(name);
+    return Klass::Int.find_method(sel);
   default:
-    std::cerr << "find_method: " << this->to_s() << std::endl;
-    exit(1);
+    raise_error("find_method: " + this->to_s());
   }
 }
 
 Object *Value::find_field(const std::string &name) {
   if (type != Type::OBJECT) {
-    std::cerr << "Value#find_field(): " << this->to_s() << std::endl;
-    exit(1);
+    raise_error("Value#find_field(): " + this->to_s());
   }
   return objval->find_field(name);
 }
@@ -0,0 +1,822 @@
+#include "holang/optimizer.hpp"
+#include "holang/heap.hpp"
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+
+using namespace std;
+using namespace holang;
+
+/*
+# Loop rotation
+
+  head: cond                    pre:  cond invariants -> temps
+        jump_ifnot exit               cond
+        body                          jump_ifnot exit
+        jump head                     body invariants -> temps
+  exit:                         body: body
+                                      cond
+                                      jump_if body
+                                exit:
+*/
+
+static bool is_jump(Instruction op) {
+  return op == Instruction::JUMP || op == Instruction::JUMP_IF ||
+         op == Instruction::JUMP_IFNOT;
+}
+
+static bool is_switch(Instruction op) {
+  return op == Instruction::TABLE_SWITCH ||
+         op == Instruction::LOOKUP_SWITCH || op == Instruction::HASH_SWITCH;
+}
+
+static bool is_binop(Instruction op) {
+  switch (op) {
+  case Instruction::ADD:
+  case Instruction::SUB:
+  case Instruction::MUL:
+  case Instruction::DIV:
+  case Instruction::MOD:
+  case Instruction::SHL:
+  case Instruction::LESS:
+  case Instruction::GREATER:
+  case Instruction::EQUAL:
+    return true;
+  default:
+    return false;
+  }
+}
+
+// instructions which neither branch, call nor fail
+static bool is_transparent(Instruction op) {
+  switch (op) {
+  case Instruction::PUT_INT:
+  case Instruction::PUT_BOOL:
+  case Instruction::PUT_STRING:
+  case Instruction::PUT_LAMBDA:
+  case Instruction::PUT_SELF:
+  case Instruction::LOAD_LOCAL:
+  case Instruction::STORE_LOCAL:
+  case Instruction::POP:
+    return true;
+  default:
+    return false;
+  }
+}
+
+static bool is_power_of_two(int x) { return x > 1 && (x & (x - 1)) == 0; }
+
+void LoopOptimizer::optimize() {
+  decode();
+  fold_constants();
+  reduce_strength();
+  fuse_induction();
+  discard_results();
+  share_local_strings();
+  move_invariants();
+  encode();
+}
+
+void LoopOptimizer::decode() {
+  vector<int> index_of(codes->size() + 1, -1);
+  size_t pc = 0;
+  while (pc < codes->size()) {
+    Insn insn;
+    insn.op = codes->at(pc).op;
+    index_of[pc] = insns.size();
+    for (int i = 0; i < operand_count(insn.op); i++) {
+      insn.operand[i] = codes->at(pc + 1 + i);
+    }
+    pc += 1 + operand_count(insn.op);
+    insns.push_back(insn);
+  }
+  index_of[codes->size()] = insns.size();
+
+  for (auto &insn : insns) {
+    if (is_jump(insn.op)) {
+      insn.target = index_of[insn.operand[0].ival];
+    }
+  }
+  for (auto handler : codes->get_handlers()) {
+    handler.begin = index_of[handler.begin];
+    handler.end = index_of[handler.end];
+    handler.target = index_of[handler.target];
+    handlers.push_back(handler);
+  }
+  for (auto table : codes->get_switches()) {
+    for (auto &target : table.targets) {
+      target = index_of[target];
+    }
+    table.otherwise = index_of[table.otherwise];
+    switches.push_back(table);
+  }
+  compact();
+}
+
+void LoopOptimizer::encode() {
+  vector<int> pos(insns.size() + 1);
+  int pc = 0;
+  for (size_t i = 0; i < insns.size(); i++) {
+    pos[i] = pc;
+    pc += 1 + operand_count(insns[i].op);
+  }
+  pos[insns.size()] = pc;
+
+  codes->clear();
+  for (const auto &insn : insns) {
+    codes->append(insn.op);
+    if (insn.target >= 0) {
+      codes->append(pos[insn.target]);
+      continue;
+    }
+    for (int i = 0; i < operand_count(insn.op); i++) {
+      codes->append(insn.operand[i]);
+    }
+  }
+  for (const auto &handler : handlers) {
+    codes->add_handler({pos[handler.begin], pos[handler.end],
+                        pos[handler.target], handler.env});
+  }
+  // switch insns keep their operand, the tables stay in the same order
+  for (auto table : switches) {
+    for (auto &target : table.targets) {
+      target = pos[target];
+    }
+    table.otherwise = pos[table.otherwise];
+    codes->add_switch(table);
+  }
+}
+
+// Drop dead insns; a jump to a dead insn lands on the next live one.
+// Boundaries of handler ranges count as jump targets, so nothing is moved
+// into or out of a try statement.
+void LoopOptimizer::compact() {
+  vector<int> index_of(insns.size() + 1);
+  vector<Insn> live;
+  for (size_t i = 0; i < insns.size(); i++) {
+    index_of[i] = live.size();
+    if (!insns[i].dead) {
+      live.push_back(insns[i]);
+    }
+  }
+  index_of[insns.size()] = live.size();
+
+  targeted.assign(live.size() + 1, false);
+  for (auto &insn : live) {
+    if (insn.target >= 0) {
+      insn.target = index_of[insn.target];
+      targeted[insn.target] = true;
+    }
+  }
+  for (auto &handler : handlers) {
+    handler.begin = index_of[handler.begin];
+    handler.end = index_of[handler.end];
+    handler.target = index_of[handler.target];
+    targeted[handler.begin] = true;
+    targeted[handler.end] = true;
+    targeted[handler.target] = true;
+  }
+  for (auto &table : switches) {
+    for (auto &target : table.targets) {
+      target = index_of[target];
+      targeted[target] = true;
+    }
+    table.otherwise = index_of[table.otherwise];
+    targeted[table.otherwise] = true;
+  }
+  insns = std::move(live);
+}
+
+// n live insns start at begin and only the first one may be jumped to
+bool LoopOptimizer::is_straight(int begin, int n) const {
+  if (begin + n > (int)insns.size()) {
+    return false;
+  }
+  for (int i = begin; i < begin + n; i++) {
+    if (insns[i].dead || (i != begin && targeted[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// put_int a, put_int b, op -> put_int (a op b)
+void LoopOptimizer::fold_constants() {
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (size_t i = 0; i + 2 < insns.size(); i++) {
+      Insn &lhs = insns[i];
+      Insn &rhs = insns[i + 1];
+      Instruction op = insns[i + 2].op;
+      if (lhs.op != Instruction::PUT_INT || rhs.op != Instruction::PUT_INT ||
+          !is_straight(i, 3)) {
+        continue;
+      }
+
+      int l = lhs.operand[0].ival;
+      int r = rhs.operand[0].ival;
+      switch (op) {
+      case Instruction::ADD:
+        lhs.operand[0].ival = l + r;
+        break;
+      case Instruction::SUB:
+        lhs.operand[0].ival = l - r;
+        break;
+      case Instruction::MUL:
+        lhs.operand[0].ival = l * r;
+        break;
+      case Instruction::DIV:
+      case Instruction::MOD:
+        if (r == 0 || (l == INT_MIN && r == -1)) {
+          continue;
+        }
+        lhs.operand[0].ival = op == Instruction::DIV ? l / r : l % r;
+        break;
+      case Instruction::LESS:
+        lhs.op = Instruction::PUT_BOOL;
+        lhs.operand[0].bval = l < r;
+        break;
+      case Instruction::GREATER:
+        lhs.op = Instruction::PUT_BOOL;
+        lhs.operand[0].bval = l > r;
+        break;
+      case Instruction::EQUAL:
+        lhs.op = Instruction::PUT_BOOL;
+        lhs.operand[0].bval = l == r;
+        break;
+      default:
+        continue;
+      }
+      insns[i + 1].dead = true;
+      insns[i + 2].dead = true;
+      changed = true;
+      i += 2;
+    }
+    compact();
+  }
+
+  // a value pushed only to be popped, e.g. the result of a while statement
+  for (size_t i = 0; i + 1 < insns.size(); i++) {
+    Instruction op = insns[i].op;
+    if (is_transparent(op) && op != Instruction::STORE_LOCAL &&
+        op != Instruction::POP && insns[i + 1].op == Instruction::POP &&
+        is_straight(i, 2)) {
+      insns[i].dead = true;
+      insns[i + 1].dead = true;
+      i++;
+    }
+  }
+  compact();
+}
+
+// put_int 2^k, mul -> put_int k, shl
+//
+// Division and modulo are left alone: they truncate toward zero, so a shift
+// or a mask would change the result for negative operands.
+void LoopOptimizer::reduce_strength() {
+  for (size_t i = 0; i + 1 < insns.size(); i++) {
+    Insn &rhs = insns[i];
+    if (rhs.op != Instruction::PUT_INT || insns[i + 1].op != Instruction::MUL ||
+        !is_power_of_two(rhs.operand[0].ival) || !is_straight(i, 2)) {
+      continue;
+    }
+    int k = 0;
+    while ((1 << k) != rhs.operand[0].ival) {
+      k++;
+    }
+    rhs.operand[0].ival = k;
+    insns[i + 1].op = Instruction::SHL;
+  }
+}
+
+// load_local i, put_int c, add, store_local i -> add_local_const i, c
+// load_local i, put_int c, sub, store_local i -> sub_local_const i, c
+void LoopOptimizer::fuse_induction() {
+  for (size_t i = 0; i + 3 < insns.size(); i++) {
+    if (!is_straight(i, 4) || insns[i + 3].op != Instruction::STORE_LOCAL) {
+      continue;
+    }
+
+    int index = insns[i + 3].operand[0].ival;
+    Instruction op = insns[i + 2].op;
+    const Insn &a = insns[i];
+    const Insn &b = insns[i + 1];
+    int c;
+    if (a.op == Instruction::LOAD_LOCAL && a.operand[0].ival == index &&
+        b.op == Instruction::PUT_INT &&
+        (op == Instruction::ADD || op == Instruction::SUB)) {
+      c = b.operand[0].ival;
+    } else if (a.op == Instruction::PUT_INT &&
+               b.op == Instruction::LOAD_LOCAL && b.operand[0].ival == index &&
+               op == Instruction::ADD) {
+      c = a.operand[0].ival;
+    } else {
+      continue;
+    }
+
+    // a subtraction stays one, so a failing one reports what was written
+    insns[i].op = op == Instruction::SUB ? Instruction::SUB_LOCAL_CONST
+                                         : Instruction::ADD_LOCAL_CONST;
+    insns[i].operand[0].ival = index;
+    insns[i].operand[1].ival = c;
+    insns[i + 1].dead = true;
+    insns[i + 2].dead = true;
+    insns[i + 3].dead = true;
+    i += 3;
+  }
+  compact();
+}
+
+// add_local_const i, c, pop -> inc_local i, c
+// load_local j, inc_local i, c, pop -> inc_local i, c
+// and the same for sub_local_const and dec_local
+void LoopOptimizer::discard_results() {
+  for (size_t i = 0; i + 1 < insns.size(); i++) {
+    if ((insns[i].op == Instruction::ADD_LOCAL_CONST ||
+         insns[i].op == Instruction::SUB_LOCAL_CONST) &&
+        insns[i + 1].op == Instruction::POP && is_straight(i, 2)) {
+      insns[i].op = insns[i].op == Instruction::ADD_LOCAL_CONST
+                        ? Instruction::INC_LOCAL
+                        : Instruction::DEC_LOCAL;
+      insns[i + 1].dead = true;
+      i++;
+    } else if (i + 2 < insns.size() &&
+               insns[i].op == Instruction::LOAD_LOCAL &&
+               (insns[i + 1].op == Instruction::INC_LOCAL ||
+                insns[i + 1].op == Instruction::DEC_LOCAL) &&
+               insns[i + 2].op == Instruction::POP && is_straight(i, 3)) {
+      insns[i].dead = true;
+      insns[i + 2].dead = true;
+      i += 2;
+    }
+  }
+  compact();
+}
+
+// Escape analysis of string literals. Sets of literal sites are followed
+// through the operand stack and the locals of the frame, and a site escapes
+// when its value is passed to a call, returned or raised. The other sites
+// only meet pops, stores, branches, switches and failing binops, which copy
+// the string at most, so one String made at compile time serves every run
+// of them. Frames with class bodies, imports or handlers are left alone.
+void LoopOptimizer::share_local_strings() {
+  vector<int> sites; // bit k of a set stands for the put_string at sites[k]
+  for (size_t i = 0; i < insns.size() && sites.size() < 64; i++) {
+    if (insns[i].op == Instruction::PUT_STRING) {
+      sites.push_back(i);
+    }
+  }
+  if (sites.empty() || !handlers.empty()) {
+    return;
+  }
+
+  struct State {
+    bool seen = false;
+    vector<uint64_t> stack;
+    vector<uint64_t> locals;
+  };
+  vector<State> states(insns.size() + 1);
+  vector<int> work;
+  auto flow = [&](int to, const State &out) {
+    State &in = states[to];
+    if (!in.seen) {
+      in = out;
+      work.push_back(to);
+      return true;
+    }
+    if (in.stack.size() != out.stack.size()) {
+      return false;
+    }
+    bool changed = false;
+    for (size_t k = 0; k < out.stack.size(); k++) {
+      changed |= (out.stack[k] & ~in.stack[k]) != 0;
+      in.stack[k] |= out.stack[k];
+    }
+    in.locals.resize(max(in.locals.size(), out.locals.size()));
+    for (size_t k = 0; k < out.locals.size(); k++) {
+      changed |= (out.locals[k] & ~in.locals[k]) != 0;
+      in.locals[k] |= out.locals[k];
+    }
+    if (changed) {
+      work.push_back(to);
+    }
+    return true;
+  };
+
+  uint64_t escaped = 0;
+  State entry;
+  entry.seen = true;
+  if (!flow(0, entry)) {
+    return;
+  }
+  while (!work.empty()) {
+    int i = work.back();
+    work.pop_back();
+    if (i == (int)insns.size()) {
+      continue;
+    }
+    const Insn &insn = insns[i];
+    State s = states[i];
+    auto pop = [&](size_t n, uint64_t *sets) {
+      if (s.stack.size() < n) {
+        return false;
+      }
+      for (; n > 0; n--) {
+        *sets |= s.stack.back();
+        s.stack.pop_back();
+      }
+      return true;
+    };
+    auto local = [&](int index) -> uint64_t & {
+      if ((int)s.locals.size() <= index) {
+        s.locals.resize(index + 1);
+      }
+      return s.locals[index];
+    };
+
+    uint64_t sets = 0;
+    bool next = true;
+    vector<int> targets;
+    switch (insn.op) {
+    case Instruction::PUT_STRING: {
+      // literals past the 64th are not followed and stay as they are
+      auto site = find(sites.begin(), sites.end(), i);
+      s.stack.push_back(site == sites.end()
+                            ? 0
+                            : (uint64_t)1 << (site - sites.begin()));
+      break;
+    }
+    case Instruction::PUT_INT:
+    case Instruction::PUT_BOOL:
+    case Instruction::PUT_LAMBDA:
+    case Instruction::PUT_OBJECT:
+    case Instruction::PUT_SELF:
+    case Instruction::DEF_FUNC:
+      s.stack.push_back(0);
+      break;
+    case Instruction::POP:
+      if (!pop(1, &sets)) {
+        return;
+      }
+      break;
+    case Instruction::STORE_LOCAL:
+      if (s.stack.empty()) {
+        return;
+      }
+      local(insn.operand[0].ival) = s.stack.back();
+      break;
+    case Instruction::LOAD_LOCAL:
+      s.stack.push_back(local(insn.operand[0].ival));
+      break;
+    case Instruction::ADD_LOCAL_CONST:
+    case Instruction::SUB_LOCAL_CONST:
+      local(insn.operand[0].ival) = 0;
+      s.stack.push_back(0);
+      break;
+    case Instruction::INC_LOCAL:
+    case Instruction::DEC_LOCAL:
+      local(insn.operand[0].ival) = 0;
+      break;
+    case Instruction::LOAD_OBJ_FIELD:
+      if (!pop(1, &sets)) {
+        return;
+      }
+      s.stack.push_back(0);
+      break;
+    case Instruction::JUMP:
+      next = false;
+      targets.push_back(insn.target);
+      break;
+    case Instruction::JUMP_IF:
+    case Instruction::JUMP_IFNOT:
+      if (!pop(1, &sets)) {
+        return;
+      }
+      targets.push_back(insn.target);
+      break;
+    case Instruction::TABLE_SWITCH:
+    case Instruction::LOOKUP_SWITCH:
+    case Instruction::HASH_SWITCH: {
+      if (!pop(1, &sets)) {
+        return;
+      }
+      const auto &table = switches[insn.operand[0].ival];
+      next = false;
+      targets = table.targets;
+      targets.push_back(table.otherwise);
+      break;
+    }
+    case Instruction::CALL_FUNC:
+    case Instruction::CALL_DIRECT:
+      if (!pop(insn.operand[1].ival + 1, &escaped)) {
+        return;
+      }
+      s.stack.push_back(0);
+      break;
+    case Instruction::RET:
+    case Instruction::RAISE:
+      if (!pop(1, &escaped)) {
+        return;
+      }
+      next = false;
+      break;
+    default:
+      if (is_binop(insn.op)) {
+        if (!pop(2, &sets)) {
+          return;
+        }
+        s.stack.push_back(0);
+        break;
+      }
+      return; // class bodies and imports switch frames
+    }
+    if (next) {
+      targets.push_back(i + 1);
+    }
+    for (int to : targets) {
+      if (!flow(to, s)) {
+        return;
+      }
+    }
+  }
+
+  for (size_t k = 0; k < sites.size(); k++) {
+    Insn &insn = insns[sites[k]];
+    if ((escaped >> k & 1) == 0 && states[sites[k]].seen) {
+      insn.op = Instruction::PUT_OBJECT;
+      insn.operand[0].objval =
+          Heap::get().make_old<String>(*insn.operand[0].sval);
+    }
+  }
+}
+
+// innermost loops first, so their invariants can bubble up further
+void LoopOptimizer::move_invariants() {
+  while (true) {
+    int back_edge = -1;
+    for (int j = 0; j < (int)insns.size(); j++) {
+      const Insn &insn = insns[j];
+      if (insn.op != Instruction::JUMP || insn.visited || insn.target > j) {
+        continue;
+      }
+      if (back_edge < 0 ||
+          j - insn.target < back_edge - insns[back_edge].target) {
+        back_edge = j;
+      }
+    }
+    if (back_edge < 0) {
+      return;
+    }
+    insns[back_edge].visited = true;
+    move_invariants(back_edge);
+  }
+}
+
+void LoopOptimizer::move_invariants(int back_edge) {
+  int head = insns[back_edge].target;
+  int test = -1;
+  for (int i = head; i < back_edge; i++) {
+    if (insns[i].op == Instruction::JUMP_IFNOT &&
+        insns[i].target == back_edge + 1) {
+      test = i;
+      break;
+    }
+  }
+  if (test < 0 || !is_loop_safe(head, test, back_edge)) {
+    return;
+  }
+
+  written.clear();
+  for (int i = head; i <= back_edge; i++) {
+    if (insns[i].op == Instruction::STORE_LOCAL ||
+        insns[i].op == Instruction::ADD_LOCAL_CONST ||
+        insns[i].op == Instruction::INC_LOCAL ||
+        insns[i].op == Instruction::SUB_LOCAL_CONST ||
+        insns[i].op == Instruction::DEC_LOCAL) {
+      written.insert(insns[i].operand[0].ival);
+    }
+  }
+
+  vector<Span> cond_spans, body_spans;
+  find_invariants(head, test, &cond_spans);
+  // body invariants go before the body, so not out of a try at its start
+  if (!targeted[test + 1]) {
+    find_invariants(test + 1, back_edge, &body_spans);
+  }
+
+  int local_size = codes->local_size();
+  vector<int> cond_temps, body_temps;
+  for (size_t i = 0; i < cond_spans.size(); i++) {
+    cond_temps.push_back(local_size++);
+  }
+  for (size_t i = 0; i < body_spans.size(); i++) {
+    body_temps.push_back(local_size++);
+  }
+
+  auto hoist = [&](const vector<Span> &spans, const vector<int> &temps,
+                   vector<Insn> *out) {
+    for (size_t s = 0; s < spans.size(); s++) {
+      for (int i = spans[s].first; i <= spans[s].second; i++) {
+        out->push_back(insns[i]);
+      }
+      Insn store, pop;
+      store.op = Instruction::STORE_LOCAL;
+      store.operand[0].ival = temps[s];
+      pop.op = Instruction::POP;
+      out->push_back(store);
+      out->push_back(pop);
+    }
+  };
+
+  // every target below is still an old index until remapped at the end
+  vector<Insn> out;
+  vector<int> index_of(insns.size() + 1);
+  for (int i = 0; i < head; i++) {
+    index_of[i] = out.size();
+    out.push_back(insns[i]);
+  }
+  int preheader = out.size();
+  hoist(cond_spans, cond_temps, &out);
+  emit_region(head, test, cond_spans, cond_temps, &out, &index_of);
+  index_of[head] = preheader;
+  index_of[test] = out.size();
+  out.push_back(insns[test]);
+
+  hoist(body_spans, body_temps, &out);
+  emit_region(test + 1, back_edge, body_spans, body_temps, &out, &index_of);
+  index_of[back_edge] = out.size();
+  emit_region(head, test, cond_spans, cond_temps, &out, nullptr);
+  Insn loop;
+  loop.op = Instruction::JUMP_IF;
+  loop.target = test + 1;
+  loop.visited = true;
+  out.push_back(loop);
+
+  for (int i = back_edge + 1; i < (int)insns.size(); i++) {
+    index_of[i] = out.size();
+    out.push_back(insns[i]);
+  }
+  index_of[insns.size()] = out.size();
+
+  for (auto &insn : out) {
+    if (insn.target >= 0) {
+      insn.target = index_of[insn.target];
+    }
+  }
+  for (auto &handler : handlers) {
+    handler.begin = index_of[handler.begin];
+    handler.end = index_of[handler.end];
+    handler.target = index_of[handler.target];
+  }
+  for (auto &table : switches) {
+    for (auto &target : table.targets) {
+      target = index_of[target];
+    }
+    table.otherwise = index_of[table.otherwise];
+  }
+  insns = std::move(out);
+  compact();
+  codes->set_local_size(local_size);
+}
+
+// Collect maximal invariant expressions from the straight-line start of
+// [begin, end). Scanning stops at the first call, branch or failing operation
+// so that a moved expression is always evaluated before anything observable.
+void LoopOptimizer::find_invariants(int begin, int end, vector<Span> *spans) {
+  struct Entry {
+    int first, last;
+    bool has_op;
+  };
+  vector<Entry> operands;
+  auto flush = [&]() {
+    for (const auto &e : operands) {
+      if (e.has_op) {
+        spans->push_back({e.first, e.last});
+      }
+    }
+    operands.clear();
+  };
+
+  for (int i = begin; i < end; i++) {
+    const Insn &insn = insns[i];
+    if (i != begin && targeted[i]) {
+      break;
+    }
+    if (is_invariant_leaf(insn)) {
+      operands.push_back({i, i, false});
+      continue;
+    }
+    if (is_binop(insn.op) && operands.size() >= 2) {
+      operands.pop_back();
+      operands.back().last = i;
+      operands.back().has_op = true;
+      continue;
+    }
+    flush();
+    // a binop moved above a store could raise before it, and a handler
+    // would see the local unchanged
+    if (!is_transparent(insn.op) || insn.op == Instruction::STORE_LOCAL) {
+      break;
+    }
+  }
+  flush();
+}
+
+void LoopOptimizer::emit_region(int begin, int end, const vector<Span> &spans,
+                                const vector<int> &temps, vector<Insn> *out,
+                                vector<int> *index_of) const {
+  size_t s = 0;
+  for (int i = begin; i < end; i++) {
+    if (s < spans.size() && spans[s].first == i) {
+      if (index_of != nullptr) {
+        for (int k = spans[s].first; k <= spans[s].second; k++) {
+          (*index_of)[k] = out->size();
+        }
+      }
+      Insn load;
+      load.op = Instruction::LOAD_LOCAL;
+      load.operand[0].ival = temps[s];
+      out->push_back(load);
+      i = spans[s].second;
+      s++;
+      continue;
+    }
+    if (index_of != nullptr) {
+      (*index_of)[i] = out->size();
+    }
+    out->push_back(insns[i]);
+  }
+}
+
+bool LoopOptimizer::is_invariant_leaf(const Insn &insn) const {
+  switch (insn.op) {
+  case Instruction::PUT_INT:
+  case Instruction::PUT_BOOL:
+  case Instruction::PUT_SELF:
+    return true;
+  case Instruction::LOAD_LOCAL:
+    return written.count(insn.operand[0].ival) == 0;
+  default:
+    return false;
+  }
+}
+
+bool LoopOptimizer::is_loop_safe(int head, int test, int back_edge) const {
+  // temporaries need a known frame, which class bodies do not have
+  if (codes->local_size() == 0) {
+    return false;
+  }
+  int env = 0;
+  for (int i = 0; i < head; i++) {
+    if (insns[i].op == Instruction::LOAD_CLASS) {
+      env++;
+    } else if (insns[i].op == Instruction::PREV_ENV) {
+      env--;
+    }
+  }
+  if (env != 0) {
+    return false;
+  }
+
+  for (int i = head; i <= back_edge; i++) {
+    switch (insns[i].op) {
+    case Instruction::LOAD_CLASS:
+    case Instruction::PREV_ENV:
+    case Instruction::IMPORT:
+      return false;
+    default:
+      break;
+    }
+    // the condition is duplicated by rotation
+    if (i < test && (is_jump(insns[i].op) || is_switch(insns[i].op))) {
+      return false;
+    }
+  }
+
+  // the only ways in are falling into head and the back edge
+  auto enters = [&](int from, int to) {
+    bool inside = head <= from && from <= back_edge;
+    return (head < to && to <= test) || (to == head && inside) ||
+           (test < to && to <= back_edge && !inside);
+  };
+  for (int i = 0; i < (int)insns.size(); i++) {
+    int to = insns[i].target;
+    if (to >= 0 && i != back_edge && enters(i, to)) {
+      return false;
+    }
+    if (!is_switch(insns[i].op)) {
+      continue;
+    }
+    const auto &table = switches[insns[i].operand[0].ival];
+    if (enters(i, table.otherwise)) {
+      return false;
+    }
+    for (int target : table.targets) {
+      if (enters(i, target)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
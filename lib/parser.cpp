@@ -3,6 +3,7 @@
 #include "holang/variable_table.hpp"
 #include <iostream>
 #include <map>
+#include <set>
 #include <vector>
 
 using namespace std;
@@ -13,9 +14,9 @@ using namespace holang;
 Node *Parser::parse() { return read_toplevel(); }
 
 void Parser::take(TokenType type) {
-  Token *token = get();
-  if (token->type != type) {
-    exit_by_unexpected(type, token);
+  Token token = get();
+  if (token.type != type) {
+    throw_unexpected(type, token);
   }
 }
 
@@ -34,7 +35,7 @@ Node *Parser::read_toplevel() {
     consume_newlines();
 
     if (root != nullptr) {
-      root = new StmtsNode(root, node);
+      root = arena.make<StmtsNode>(root, node);
     } else {
       root = node;
     }
@@ -48,6 +49,8 @@ Node *Parser::read_stmt() {
   Node *node;
   if (is_next(TokenType::If)) {
     node = read_if();
+  } else if (is_next(TokenType::Case)) {
+    node = read_case();
   } else if (is_next(TokenType::Func)) {
     node = read_funcdef();
   } else if (is_next(TokenType::Class)) {
@@ -58,6 +61,10 @@ Node *Parser::read_stmt() {
     node = read_while();
   } else if (is_next(TokenType::Return)) {
     node = read_return();
+  } else if (is_next(TokenType::Try)) {
+    node = read_try();
+  } else if (is_next(TokenType::Raise)) {
+    node = read_raise();
   } else if (is_next(TokenType::BraseL)) {
     node = read_suite();
   } else {
@@ -69,53 +76,163 @@ Node *Parser::read_stmt() {
 Node *Parser::read_if() {
   take(TokenType::If);
   Node *node = read_expr();
-  Node *then = read_suite();
-  Node *els = next_token(TokenType::Else) ? read_stmt() : nullptr;
-  return new IfNode(node, then, els);
+  Node *then = read_branch();
+  Node *els = nullptr;
+  if (next_token(TokenType::Else)) {
+    auto outer_sealed_funcs = sealed_funcs;
+    els = read_stmt();
+    sealed_funcs = outer_sealed_funcs;
+  }
+  return arena.make<IfNode>(node, then, els);
+}
+
+Node *Parser::read_case() {
+  take(TokenType::Case);
+  Node *subject = read_expr();
+  take(TokenType::BraseL);
+  consume_newlines();
+
+  vector<CaseNode::When> whens;
+  // a label given twice would never reach its second body
+  set<int64_t> ints;
+  set<string> strings;
+  while (next_token(TokenType::When)) {
+    CaseNode::When when;
+    do {
+      bool minus = next_token(TokenType::Minus);
+      Token label = get();
+      bool repeated = false;
+      if (label.type == TokenType::Integer) {
+        // a label is signed as a whole, so -2147483648 is one
+        int64_t value =
+            read_integer(label, minus ? -(int64_t)INT_MIN : INT_MAX);
+        when.ints.push_back(minus ? -value : value);
+        repeated = !ints.insert(when.ints.back()).second;
+      } else if (label.type == TokenType::String && !minus) {
+        when.strings.push_back(label.str());
+        repeated = !strings.insert(when.strings.back()).second;
+      } else {
+        throw_unexpected("integer or string literal", label);
+      }
+      if (repeated) {
+        throw_unexpected("a label not given before in this case", label);
+      }
+    } while (next_token(TokenType::Comma));
+    when.body = read_branch();
+    consume_newlines();
+    whens.push_back(when);
+  }
+
+  Node *els = nullptr;
+  if (next_token(TokenType::Else)) {
+    els = read_branch();
+    consume_newlines();
+  }
+  take(TokenType::BraseR);
+  return arena.make<CaseNode>(subject, whens, els);
 }
 
 Node *Parser::read_funcdef() {
   take(TokenType::Func);
-  Token *ident = get_ident();
+  Token ident = get_ident();
   variable_table.next();
 
   take(TokenType::ParenL);
-  vector<string *> params;
+  vector<const string *> params;
   read_params(&params);
-  for (string *str : params) {
+  for (const string *str : params) {
     variable_table.insert(*str);
   }
   take(TokenType::ParenR);
+  bool is_sealed = next_token(TokenType::Sealed);
 
+  auto *node = arena.make<FuncDefNode>(ident.text(), params, is_sealed);
+  if (is_sealed) {
+    sealed_funcs[ident.text()] = node;
+  }
+
+  auto outer_sealed_funcs = sealed_funcs;
+  int outer_class_depth = class_depth;
+  class_depth = 0;
+  vector<FuncDefNode *> body_callees;
+  auto *outer_callees = callees;
+  callees = &body_callees;
   Node *body = read_suite();
+  sealed_funcs = outer_sealed_funcs;
+  class_depth = outer_class_depth;
+  callees = outer_callees;
+
+  int local_size = variable_table.size();
   variable_table.prev();
-  return new FuncDefNode(ident->str, params, body);
+  node->set_body(body, local_size, body_callees);
+  return node;
 }
 
 Node *Parser::read_klassdef() {
   take(TokenType::Class);
-  Token *ident = get_ident();
+  Token ident = get_ident();
+  string superclass;
+  if (next_token(TokenType::LessThan)) {
+    superclass = get_ident().text();
+  }
+
+  auto outer_sealed_funcs = sealed_funcs;
+  sealed_funcs.clear();
+  class_depth++;
   Node *body = read_suite();
-  return new KlassDefNode(ident->str, body);
+  class_depth--;
+  sealed_funcs = outer_sealed_funcs;
+  return arena.make<KlassDefNode>(ident.text(), superclass, body);
 }
 
 Node *Parser::read_import() {
   take(TokenType::Import);
   Node *node = read_expr();
-  return new ImportNode(node);
+  auto *literal = dynamic_cast<StringLiteralNode *>(node);
+  if (literal != nullptr) {
+    imported.push_back(literal->get_value());
+  }
+  return arena.make<ImportNode>(node);
 }
 
 Node *Parser::read_while() {
   take(TokenType::While);
   Node *node = read_expr();
-  Node *body = read_suite();
-  return new WhileNode(node, body);
+  Node *body = read_branch();
+  return arena.make<WhileNode>(node, body);
 }
 
 Node *Parser::read_return() {
   take(TokenType::Return);
   Node *node = read_expr();
-  return new ReturnNode(node);
+  return arena.make<ReturnNode>(node);
+}
+
+Node *Parser::read_try() {
+  take(TokenType::Try);
+  Node *body = read_branch();
+  take(TokenType::Catch);
+  Token ident = get_ident();
+  // the handler stores the exception into this frame
+  int index = variable_table.insert_local(ident.text());
+  Node *handler = read_branch();
+  auto *var = arena.make<IdentNode>(ident.text(), 0, index);
+  return arena.make<TryNode>(body, var, handler, class_depth);
+}
+
+Node *Parser::read_raise() {
+  take(TokenType::Raise);
+  Node *node = read_expr();
+  return arena.make<RaiseNode>(node);
+}
+
+// a suite that may not run: sealed functions it defines are not bound after
+// it
+Node *Parser::read_branch() {
+  auto outer_sealed_funcs = sealed_funcs;
+  Node *suite = read_suite();
+  sealed_funcs = outer_sealed_funcs;
+  return suite;
 }
 
 Node *Parser::read_suite() {
@@ -128,7 +245,7 @@ Node *Parser::read_suite() {
     consume_newlines();
 
     if (suite != nullptr) {
-      suite = new StmtsNode(suite, node);
+      suite = arena.make<StmtsNode>(suite, node);
     } else {
       suite = node;
     }
@@ -142,20 +259,44 @@ Node *Parser::read_suite() {
 Node *Parser::read_expr() { return read_assignment_expr(); }
 
 Node *Parser::read_assignment_expr() {
-  Token *token = get();
-  if (token->type == TokenType::Ident && next_token(TokenType::Assign)) {
-    auto pair = variable_table.insert_if_absent(token->str);
+  Token token = get();
+  if (token.type == TokenType::Ident && next_token(TokenType::Assign)) {
+    auto pair = variable_table.insert_if_absent(token.text());
     int depth = pair.first;
     int index = pair.second;
-    return new AssignNode(new IdentNode(token->str, depth, index),
-                          read_assignment_expr());
+    auto *var = arena.make<IdentNode>(token.text(), depth, index);
+    return arena.make<AssignNode>(var, read_assignment_expr());
+  }
+  if (token.type == TokenType::Ident) {
+    TokenType op;
+    switch (get().type) {
+    case TokenType::PlusAssign:
+      op = TokenType::Plus;
+      break;
+    case TokenType::MinusAssign:
+      op = TokenType::Minus;
+      break;
+    case TokenType::MulAssign:
+      op = TokenType::Mul;
+      break;
+    case TokenType::DivAssign:
+      op = TokenType::Div;
+      break;
+    default:
+      op = TokenType::Assign;
+      unget();
+    }
+    if (op != TokenType::Assign) {
+      return arena.make<CompoundAssignNode>(op, find_ident(token),
+                                            read_assignment_expr());
+    }
   }
   unget();
   return read_equal_expr();
 }
 
-Node *ast_binop(TokenType op, Node *lhs, Node *rhs) {
-  return new BinopNode(op, lhs, rhs);
+Node *Parser::ast_binop(TokenType op, Node *lhs, Node *rhs) {
+  return arena.make<BinopNode>(op, lhs, rhs);
 }
 
 Node *Parser::read_equal_expr() {
@@ -204,7 +345,16 @@ Node *Parser::read_additive_expr() {
 
 Node *Parser::read_factor() {
   if (next_token(TokenType::Minus)) {
-    return new SignChangeNode(read_prime_expr());
+    return arena.make<SignChangeNode>(read_prime_expr());
+  } else if (is_next(TokenType::PlusPlus) || is_next(TokenType::MinusMinus)) {
+    int amount = get().type == TokenType::PlusPlus ? 1 : -1;
+    return arena.make<IncrementNode>(find_ident(get_ident()), amount, true);
+  } else if (is_next(TokenType::Ident) &&
+             (is_next(TokenType::PlusPlus, 1) ||
+              is_next(TokenType::MinusMinus, 1))) {
+    Token ident = get();
+    int amount = get().type == TokenType::PlusPlus ? 1 : -1;
+    return arena.make<IncrementNode>(find_ident(ident), amount, false);
   } else {
     return read_prime_expr();
   }
@@ -217,7 +367,7 @@ Node *Parser::read_prime_expr() {
     if (traier == nullptr) {
       break;
     }
-    node = new PrimeExprNode(node, traier);
+    node = arena.make<PrimeExprNode>(node, traier);
   }
   return node;
 }
@@ -237,28 +387,26 @@ Node *Parser::read_prime() {
   } else if (is_next(TokenType::Ident)) {
     return read_name_or_funccall(false);
   } else if (next_token(TokenType::True)) {
-    return new BoolLiteralNode(true);
+    return arena.make<BoolLiteralNode>(true);
   } else if (next_token(TokenType::False)) {
-    return new BoolLiteralNode(false);
+    return arena.make<BoolLiteralNode>(false);
   } else if (is_next(TokenType::String)) {
     return read_string();
   }
-  exit_by_unexpected("something prime", get());
+  throw_unexpected("something prime", get());
   return nullptr;
 }
 
 Node *Parser::read_number() {
-  Token *token = get();
-  return new IntLiteralNode(token->i);
+  return arena.make<IntLiteralNode>(read_integer(get()));
 }
 
 Node *Parser::read_string() {
-  Token *token = get();
-  return new StringLiteralNode(token->str);
+  return arena.make<StringLiteralNode>(get().str());
 }
 
 Node *Parser::read_name_or_funccall(bool is_trailer) {
-  Token *ident = get();
+  Token ident = get();
   if (next_token(TokenType::ParenL)) {
     vector<Node *> args;
     if (!next_token(TokenType::ParenR)) {
@@ -268,25 +416,39 @@ Node *Parser::read_name_or_funccall(bool is_trailer) {
     if (is_next(TokenType::BraseL)) {
       args.push_back(read_block());
     }
-    return new FuncCallNode(ident->str, args, is_trailer);
+    FuncDefNode *callee = nullptr;
+    if (!is_trailer) {
+      auto it = sealed_funcs.find(ident.text());
+      if (it != sealed_funcs.end()) {
+        callee = it->second;
+        if (callees != nullptr) {
+          callees->push_back(callee);
+        }
+      }
+    }
+    return arena.make<FuncCallNode>(ident.text(), args, is_trailer, callee);
   } else {
     if (is_trailer) {
-      return new RefFieldNode(ident->str);
+      return arena.make<RefFieldNode>(ident.text());
     } else {
-      auto pair = variable_table.find(ident->str);
-      if (pair.first < 0) {
-        exit_by_unexpected("It is not defined", ident);
-      }
-      int depth = pair.first;
-      int index = pair.second;
-      return new IdentNode(ident->str, depth, index);
+      return find_ident(ident);
     }
   }
 }
 
+IdentNode *Parser::find_ident(const Token &ident) {
+  auto pair = variable_table.find(ident.text());
+  if (pair.first < 0) {
+    throw_unexpected("It is not defined", ident);
+  }
+  int depth = pair.first;
+  int index = pair.second;
+  return arena.make<IdentNode>(ident.text(), depth, index);
+}
+
 Node *Parser::read_block() {
   Node *suite = nullptr;
-  vector<string *> params;
+  vector<const string *> params;
 
   take(TokenType::BraseL);
   if (next_token(TokenType::VertialBar)) {
@@ -299,21 +461,34 @@ Node *Parser::read_block() {
     variable_table.insert(*str);
   }
 
+  // a block is not run on the self it is written in
+  auto outer_sealed_funcs = sealed_funcs;
+  sealed_funcs.clear();
+  int outer_class_depth = class_depth;
+  class_depth = 0;
+  vector<FuncDefNode *> body_callees;
+  auto *outer_callees = callees;
+  callees = &body_callees;
+
   consume_newlines();
   while (!is_next(TokenType::BraseR)) {
     Node *node = read_stmt();
     consume_newlines();
 
     if (suite != nullptr) {
-      suite = new StmtsNode(suite, node);
+      suite = arena.make<StmtsNode>(suite, node);
     } else {
       suite = node;
     }
   }
   take(TokenType::BraseR);
 
+  sealed_funcs = outer_sealed_funcs;
+  class_depth = outer_class_depth;
+  callees = outer_callees;
+  int local_size = variable_table.size();
   variable_table.prev();
-  return new LambdaNode(params, suite);
+  return arena.make<LambdaNode>(params, suite, local_size, body_callees);
 }
 
 void Parser::read_exprs(vector<Node *> &args) {
@@ -336,15 +511,15 @@ void Parser::read_arglist(vector<Node *> *arglist) {
   }
 }
 
-void Parser::read_params(vector<string *> *params) {
+void Parser::read_params(vector<const string *> *params) {
   if (!is_next(TokenType::Ident)) {
     return;
   }
 
-  Token *token = get_ident();
-  params->emplace_back(&token->str);
+  Token token = get_ident();
+  params->emplace_back(CodeSequence::intern(token.text()));
   while (next_token(TokenType::Comma)) {
     token = get_ident();
-    params->emplace_back(&token->str);
+    params->emplace_back(CodeSequence::intern(token.text()));
   }
 }
@@ -0,0 +1,105 @@
+#include "holang/scan.hpp"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+using namespace std;
+using namespace holang;
+
+namespace {
+struct Scanners {
+  const char *(*find_quote)(const char *);
+  const char *(*find_newline)(const char *);
+  const char *isa;
+};
+
+const char *find_quote_scalar(const char *p) {
+  while (*p != '"' && *p != '\0') {
+    p++;
+  }
+  return p;
+}
+
+const char *find_newline_scalar(const char *p) {
+  while (*p != '\n' && *p != '\0') {
+    p++;
+  }
+  return p;
+}
+
+const Scanners scalar = {find_quote_scalar, find_newline_scalar, "scalar"};
+
+#if defined(__x86_64__)
+// first byte equal to c or NUL
+template <char c> const char *find_sse2(const char *p) {
+  for (;; p += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)p);
+    unsigned found =
+        _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(c)),
+                                       _mm_cmpeq_epi8(v, _mm_setzero_si128())));
+    if (found != 0) {
+      return p + __builtin_ctz(found);
+    }
+  }
+}
+
+const Scanners sse2 = {find_sse2<'"'>, find_sse2<'\n'>, "sse2"};
+
+template <char c>
+__attribute__((target("avx2"))) const char *find_avx2(const char *p) {
+  for (;; p += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)p);
+    unsigned found = _mm256_movemask_epi8(
+        _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(c)),
+                        _mm256_cmpeq_epi8(v, _mm256_setzero_si256())));
+    if (found != 0) {
+      return p + __builtin_ctz(found);
+    }
+  }
+}
+
+const Scanners avx2 = {find_avx2<'"'>, find_avx2<'\n'>, "avx2"};
+
+bool has_avx2() {
+  __builtin_cpu_init(); // this may run before the constructors of libgcc
+  return __builtin_cpu_supports("avx2");
+}
+#endif
+
+const Scanners *widest() {
+#if defined(__x86_64__)
+  return has_avx2() ? &avx2 : &sse2;
+#else
+  return &scalar;
+#endif
+}
+
+const Scanners *current = widest();
+} // namespace
+
+const char *scan::find_quote(const char *p) { return current->find_quote(p); }
+
+const char *scan::find_newline(const char *p) {
+  return current->find_newline(p);
+}
+
+const char *scan::isa() { return current->isa; }
+
+bool scan::select(const string &name) {
+  if (name == "scalar") {
+    current = &scalar;
+    return true;
+  }
+#if defined(__x86_64__)
+  if (name == "sse2") {
+    current = &sse2;
+    return true;
+  }
+  if (name == "avx2" && has_avx2()) {
+    current = &avx2;
+    return true;
+  }
+#endif
+  return false;
+}
@@ -0,0 +1,23 @@
+#include "holang/slab.hpp"
+#include <cstdlib>
+#include <new>
+
+using namespace std;
+using namespace holang;
+
+SlabAllocator::~SlabAllocator() {
+  for (void *slab : slabs) {
+    ::free(slab);
+  }
+}
+
+// the tail of a slab that does not fit a whole cell is wasted
+void SlabAllocator::refill(SizeClass &sc, size_t cell) {
+  void *slab = aligned_alloc(cache_line, slab_size);
+  if (slab == nullptr) {
+    throw bad_alloc();
+  }
+  slabs.push_back(slab);
+  sc.top = (char *)slab;
+  sc.end = sc.top + slab_size / cell * cell;
+}
@@ -0,0 +1,68 @@
+#include "holang/source.hpp"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace holang;
+
+SourceFile::SourceFile(const string &path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return;
+  }
+  struct stat st;
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+    if (!map(fd, st.st_size)) {
+      read_all(fd);
+    }
+  } else {
+    read_all(fd);
+  }
+  close(fd);
+}
+
+SourceFile::~SourceFile() {
+  if (mapped != 0) {
+    munmap((void *)text, mapped);
+  }
+}
+
+// Zero pages are reserved for the file and the padding first, and the file
+// is mapped over their beginning. The rest of its last page reads as zero,
+// and so do the pages after it.
+bool SourceFile::map(int fd, size_t size) {
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t length = (size + padding + page - 1) / page * page;
+  void *region = mmap(nullptr, length, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS,
+                      -1, 0);
+  if (region == MAP_FAILED) {
+    return false;
+  }
+  if (size > 0 && mmap(region, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd,
+                       0) == MAP_FAILED) {
+    munmap(region, length);
+    return false;
+  }
+  madvise(region, length, MADV_SEQUENTIAL);
+  text = (const char *)region;
+  text_size = size;
+  mapped = length;
+  return true;
+}
+
+bool SourceFile::read_all(int fd) {
+  char buf[1 << 16];
+  ssize_t n;
+  while ((n = read(fd, buf, sizeof(buf))) > 0) {
+    copy.append(buf, n);
+  }
+  if (n < 0) {
+    return false;
+  }
+  text_size = copy.size();
+  copy.append(padding, '\0');
+  text = copy.data();
+  return true;
+}
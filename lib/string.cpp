@@ -1,5 +1,8 @@
 #include "holang/string.hpp"
 #include "holang.hpp"
+#include "holang/exception.hpp"
+#include "holang/heap.hpp"
+#include <algorithm>
 
 using namespace holang;
 
@@ -7,16 +10,21 @@ static Value reverse_func(Value *self, Value *, int) {
   String *str = (String *)self->objval;
   std::string rev = str->str;
   std::reverse(rev.begin(), rev.end());
-  return Value((Object *)new String(rev));
+  return Value((Object *)Heap::get().make<String>(rev));
 }
 
 static Value to_i(Value *self, Value *, int) {
   String *str = (String *)self->objval;
-  int i = stoi(str->str);
-  return Value(i);
+  try {
+    return Value(stoi(str->str));
+  } catch (const std::logic_error &) {
+    raise_error("invalid number: " + str->str);
+  }
 }
 
 void String::init() {
-  Klass::String.set_method("reverse", new Func((NativeFunc)reverse_func));
-  Klass::String.set_method("to_i", new Func((NativeFunc)to_i));
+  Heap &heap = Heap::get();
+  Klass::String.set_method("reverse",
+                           heap.make<Func>((NativeFunc)reverse_func));
+  Klass::String.set_method("to_i", heap.make<Func>((NativeFunc)to_i));
 }
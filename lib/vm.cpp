@@ -1,30 +1,69 @@
 #include "holang/vm.hpp"
-#include "config.hpp"
 #include "holang.hpp"
+#include <chrono>
 
 using namespace holang;
 
+namespace {
+// steps between two reads of the clock under a time limit
+const uint64_t clock_interval = 1024;
+const uint64_t no_limit = std::numeric_limits<uint64_t>::max();
+
+double now_ms() {
+  std::chrono::duration<double, std::milli> now =
+      std::chrono::steady_clock::now().time_since_epoch();
+  return now.count();
+}
+} // namespace
+
 Object *HolangVM::main_obj = nullptr;
-std::vector<string> HolangVM::import_search_path;
+uint64_t HolangVM::countdown = no_limit;
+uint64_t HolangVM::steps = 0;
+uint64_t HolangVM::interval = no_limit;
+uint64_t HolangVM::step_limit = 0;
+double HolangVM::deadline = 0;
+
+void HolangVM::set_step_limit(uint64_t limit) {
+  step_limit = limit;
+  steps = 0;
+  interval = countdown = 1;
+}
 
-void HolangVM::init_import_search_path() {
-  if (import_search_path.size() != 0) {
-    return;
+void HolangVM::set_time_limit(double ms) {
+  deadline = ms > 0 ? now_ms() + ms : 0;
+  steps += interval - countdown;
+  interval = countdown = 1;
+}
+
+// counts the steps of the countdown that ran out and starts the next one;
+// a limit once exceeded stays so until it is set again
+void HolangVM::check_limits() {
+  steps += interval;
+  interval = countdown = 1;
+  if (step_limit != 0 && steps > step_limit) {
+    throw LimitExceeded("step limit exceeded: " + std::to_string(step_limit) +
+                        " steps");
+  }
+  if (deadline != 0 && now_ms() > deadline) {
+    throw LimitExceeded("time limit exceeded");
   }
+  interval = deadline != 0 ? clock_interval : no_limit;
+  if (step_limit != 0) {
+    interval = std::min(interval, step_limit - steps + 1);
+  }
+  countdown = interval;
+}
 
-#ifdef PATH_HOLIB
-  import_search_path.push_back(PATH_HOLIB);
-#else
-  import_search_path.push_back("/");
-#endif
+void holang::raise_error(const std::string &message) {
+  throw RaiseException(Value((Object *)Heap::get().make<String>(message)));
 }
 
 void holang::call_func_argc_zero(Value *self, Func *func) {
   if (func->type == FBUILTIN) {
     func->native(self, nullptr, 0);
   } else {
-    HolangVM vm(0);
-    vm.codes = &func->body;
+    HolangVM vm(func->code()->local_size());
+    vm.codes = func->body.get();
     vm.eval();
   }
 }
@@ -33,8 +72,8 @@ void holang::call_func_argc_one(Value *self, Func *func, Value *arg) {
   if (func->type == FBUILTIN) {
     func->native(self, arg, 1);
   } else {
-    HolangVM vm(arg, 1);
-    vm.codes = &func->body;
+    HolangVM vm(arg, 1, func->code()->local_size());
+    vm.codes = func->body.get();
     vm.eval();
   }
 }
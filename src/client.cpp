@@ -0,0 +1,106 @@
+// ho-client SOCKET SCRIPT [OPTIONS]: runs a script as ho would, on the
+// server started by ho --server SOCKET, with the stdio of this process.
+// Only libc is used, so it starts faster than ho itself.
+#include "server.hpp"
+#include <cerrno>
+#include <climits>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace holang;
+
+static bool write_all(int fd, const char *data, size_t size) {
+  while (size > 0) {
+    ssize_t n = write(fd, data, size);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    data += n;
+    size -= n;
+  }
+  return true;
+}
+
+static int fail(const char *what) {
+  fprintf(stderr, "ho-client: %s: %s\n", what, strerror(errno));
+  return -1;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 3) {
+    fprintf(stderr, "usage: ho-client SOCKET SCRIPT [OPTIONS]\n");
+    return -1;
+  }
+
+  // the working directory, then the arguments of ho
+  static char request[max_server_request];
+  if (getcwd(request, PATH_MAX) == nullptr) {
+    return fail("getcwd");
+  }
+  uint32_t size = strlen(request) + 1;
+  for (int i = 2; i < argc; i++) {
+    size_t length = strlen(argv[i]) + 1;
+    if (length > sizeof(request) - size) {
+      fprintf(stderr, "ho-client: arguments too long\n");
+      return -1;
+    }
+    memcpy(request + size, argv[i], length);
+    size += length;
+  }
+
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (strlen(argv[1]) >= sizeof(address.sun_path)) {
+    fprintf(stderr, "ho-client: %s: socket path too long\n", argv[1]);
+    return -1;
+  }
+  strcpy(address.sun_path, argv[1]);
+  int conn = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (conn < 0 ||
+      connect(conn, (struct sockaddr *)&address, sizeof(address)) != 0) {
+    return fail(argv[1]);
+  }
+
+  int fds[3] = {0, 1, 2};
+  char control[CMSG_SPACE(sizeof(fds))];
+  memset(control, 0, sizeof(control));
+  struct iovec iov = {&size, sizeof(size)};
+  struct msghdr message;
+  memset(&message, 0, sizeof(message));
+  message.msg_iov = &iov;
+  message.msg_iovlen = 1;
+  message.msg_control = control;
+  message.msg_controllen = sizeof(control);
+  struct cmsghdr *fd_message = CMSG_FIRSTHDR(&message);
+  fd_message->cmsg_level = SOL_SOCKET;
+  fd_message->cmsg_type = SCM_RIGHTS;
+  fd_message->cmsg_len = CMSG_LEN(sizeof(fds));
+  memcpy(CMSG_DATA(fd_message), fds, sizeof(fds));
+  if (sendmsg(conn, &message, MSG_NOSIGNAL) != sizeof(size) ||
+      !write_all(conn, request, size)) {
+    return fail("send");
+  }
+
+  int32_t status;
+  if (recv(conn, &status, sizeof(status), MSG_WAITALL) != sizeof(status)) {
+    fprintf(stderr, "ho-client: the server closed the connection\n");
+    return 1;
+  }
+  if (WIFSIGNALED(status)) {
+    // ended as the script did
+    signal(WTERMSIG(status), SIG_DFL);
+    raise(WTERMSIG(status));
+    return 128 + WTERMSIG(status);
+  }
+  return WEXITSTATUS(status);
+}
@@ -1,67 +1,327 @@
 #include "holang.hpp"
+#include "holang/bundle.hpp"
+#include "holang/bytecode.hpp"
+#include "holang/exception.hpp"
 #include "holang/lexer.hpp"
+#include "holang/loader.hpp"
+#include "holang/optimizer.hpp"
 #include "holang/parser.hpp"
+#include "holang/source.hpp"
 #include "holang/vm.hpp"
-#include <fstream>
+#include "server.hpp"
 #include <iostream>
+#include <sys/resource.h>
 
 using namespace std;
 using namespace holang;
 
-int main(int argc, char *argv[]) {
+// 64m -> 64 * 2^20, 0 when invalid
+static size_t parse_size(const string &str) {
+  size_t pos;
+  unsigned long long size;
+  try {
+    size = stoull(str, &pos);
+  } catch (const std::logic_error &) {
+    return 0;
+  }
+  string unit = str.substr(pos);
+  if (unit == "k" || unit == "K") {
+    size <<= 10;
+  } else if (unit == "m" || unit == "M") {
+    size <<= 20;
+  } else if (unit == "g" || unit == "G") {
+    size <<= 30;
+  } else if (!unit.empty()) {
+    return 0;
+  }
+  return size;
+}
+
+// ho bundle main.ho [-o app.hob]
+static int bundle(int argc, char *argv[]) {
+  string main, out;
+  for (int i = 2; i < argc; i++) {
+    string opt(argv[i]);
+    if (opt == "-o" && i + 1 < argc) {
+      out = argv[++i];
+    } else if (opt == "--no-cache") {
+      Bytecode::set_cache_dir("");
+    } else if (main.empty() && opt[0] != '-') {
+      main = opt;
+    } else {
+      cerr << "usage: ho bundle main.ho [-o app.hob]" << endl;
+      return -1;
+    }
+  }
+  if (main.empty()) {
+    cerr << "usage: ho bundle main.ho [-o app.hob]" << endl;
+    return -1;
+  }
+  if (out.empty()) {
+    size_t dot = main.rfind('.');
+    size_t slash = main.rfind('/');
+    if (dot != string::npos && (slash == string::npos || dot > slash)) {
+      out = main.substr(0, dot) + ".hob";
+    } else {
+      out = main + ".hob";
+    }
+  }
+  try {
+    Bundle::Stats stats = Bundle::write(main, out);
+    cerr << out << ": " << stats.modules << " modules, " << stats.stripped
+         << " of " << stats.functions << " top level functions left out, "
+         << stats.bytes << " bytes" << endl;
+  } catch (const SyntaxError &e) {
+    cerr << e.what() << endl;
+    return 1;
+  } catch (const RaiseException &e) { // a module gone since it was found
+    Value exception = e.value;
+    cerr << exception.to_s() << endl;
+    return 1;
+  } catch (const std::runtime_error &e) {
+    cerr << e.what() << endl;
+    return 1;
+  }
+  return 0;
+}
+
+// ho SCRIPT [OPTIONS], in this process or a child of the server
+static int run(int argc, char *argv[]) {
   bool show_ast = false;
   bool show_token = false;
+  bool show_gc_stats = false;
+  bool show_compile_stats = false;
+  bool compile_only = false;
+  double time_limit = 0;
   if (argc < 2) {
     cerr << "require source code" << endl;
     return -1;
   }
+  if (string(argv[1]) == "bundle") {
+    return bundle(argc, argv);
+  }
 
-  if (argc >= 3) {
-    string opt(argv[2]);
+  for (int i = 2; i < argc; i++) {
+    string opt(argv[i]);
     if (opt == "--ast") {
       show_ast = true;
     } else if (opt == "--token") {
       show_token = true;
+    } else if (opt == "--gc-stats") {
+      show_gc_stats = true;
+    } else if (opt == "--compile-stats") {
+      show_compile_stats = true;
+    } else if (opt == "--no-cache") {
+      // neither reads nor writes the bytecode cache
+      Bytecode::set_cache_dir("");
+    } else if (opt.compare(0, 12, "--cache-dir=") == 0) {
+      Bytecode::set_cache_dir(opt.substr(12));
+    } else if (opt == "--compile-only") {
+      // fills the bytecode cache, or checks the syntax, without running
+      compile_only = true;
+    } else if (opt == "--gc=marksweep") {
+      Heap::get().set_generational(false);
+    } else if (opt == "--gc=generational") {
+      Heap::get().set_generational(true);
+    } else if (opt.compare(0, 13, "--heap-limit=") == 0) {
+      size_t limit = parse_size(opt.substr(13));
+      if (limit == 0) {
+        cerr << "invalid heap limit: " << opt.substr(13) << endl;
+        return -1;
+      }
+      Heap::get().set_limit(limit);
+    } else if (opt.compare(0, 13, "--step-limit=") == 0) {
+      // calls and loop iterations
+      size_t steps = parse_size(opt.substr(13));
+      if (steps == 0) {
+        cerr << "invalid step limit: " << opt.substr(13) << endl;
+        return -1;
+      }
+      HolangVM::set_step_limit(steps);
+    } else if (opt.compare(0, 13, "--time-limit=") == 0) {
+      // milliseconds
+      double ms = 0;
+      try {
+        ms = stod(opt.substr(13));
+      } catch (const std::logic_error &) {
+      }
+      if (!(ms > 0)) {
+        cerr << "invalid time limit: " << opt.substr(13) << endl;
+        return -1;
+      }
+      time_limit = ms;
+    } else if (opt.compare(0, 17, "--import-threads=") == 0) {
+      // threads parsing imported modules ahead, 0 to parse them on import
+      size_t pos = 0;
+      unsigned long threads = 0;
+      try {
+        threads = stoul(opt.substr(17), &pos);
+      } catch (const std::logic_error &) {
+        pos = 0;
+      }
+      if (pos == 0 || pos != opt.size() - 17) {
+        cerr << "invalid import threads: " << opt.substr(17) << endl;
+        return -1;
+      }
+      ModuleLoader::get().set_workers(threads);
+    } else if (opt.compare(0, 11, "--gc-pause=") == 0) {
+      // milliseconds, marks and sweeps the old space incrementally
+      double ms = 0;
+      try {
+        ms = stod(opt.substr(11));
+      } catch (const std::logic_error &) {
+      }
+      if (!(ms > 0)) {
+        cerr << "invalid pause target: " << opt.substr(11) << endl;
+        return -1;
+      }
+      Heap::get().set_pause_target(ms);
     }
   }
 
   string src(argv[1]);
-  ifstream ifs(src);
-  if (ifs.fail()) {
-    std::cerr << src << ": Not found." << std::endl;
-    return -1;
-  }
-  istreambuf_iterator<char> it(ifs);
-  istreambuf_iterator<char> last;
-  string code(it, last);
+  CodeSequence codes(src);
+  size_t n_tokens, token_bytes, arena_bytes;
+  bool cached = false; // from the bytecode cache or a bundle
+  shared_ptr<Bundle> bundled;
+  try {
+    // the source and tokens are released once code is generated, the
+    // nodes once no function is left to compile from them
+    auto source = make_shared<const SourceFile>(src);
+    if (source->fail()) {
+      std::cerr << src << ": Not found." << std::endl;
+      return -1;
+    }
+    if (Bundle::is_bundle(*source)) {
+      // its modules are code; the mapping is kept while any is left
+      bundled = Bundle::open(source);
+      if (bundled == nullptr) {
+        std::cerr << src << ": broken bundle" << std::endl;
+        return 1;
+      }
+      ModuleLoader::set_bundle(bundled);
+    }
+    holang::Lexer lexer(source->data(), source->size());
 
-  vector<Token *> token_chain;
-  holang::Lexer lexer(code);
-  lexer.lex(token_chain);
+    if (show_token) {
+      Token token;
+      do {
+        token = lexer.next();
+        token.print(cout);
+        cout << endl;
+      } while (token.type != TokenType::TEOF);
+      return 0;
+    }
 
-  if (show_token) {
-    for (auto *token : token_chain) {
-      cout << token << endl;
+    uint64_t source_hash = 0;
+    shared_ptr<Bytecode> bytecode;
+    if (bundled != nullptr) {
+      bytecode = bundled->module(bundled->main_path());
+    } else if (Bytecode::enabled() && !show_ast) {
+      source_hash = Bytecode::hash(source->data(), source->size());
+      bytecode = Bytecode::load(source_hash, source->size());
     }
-    return 0;
+    // the code is not a root until it is complete, however this is left
+    HeapPause pause;
+    if (bytecode != nullptr) {
+      ModuleLoader::get().preload(bytecode->imports());
+      cached = bytecode->instantiate(codes);
+      if (!cached && bundled != nullptr) {
+        std::cerr << src << ": broken bundle" << std::endl;
+        return 1;
+      }
+      if (!cached) {
+        // a broken entry is a miss: compiled again, and replaced
+        bytecode->drop();
+      }
+    }
+    if (!cached) {
+      // tokens are lexed as the parser takes them
+      TokenStream tokens(lexer);
+      auto arena = make_shared<Arena>();
+      holang::Parser parser(tokens, *arena);
+      Node *root = parser.parse();
+      if (root == nullptr) {
+        return 0;
+      }
+      if (show_ast) {
+        root->print(0);
+        return 0;
+      }
+      // imported modules are parsed while this one is compiled and run
+      ModuleLoader::get().preload(parser.imports());
+      {
+        LazyScope scope(arena);
+        root->code_gen(&codes);
+      }
+      // as an imported module is, the same source has the same code
+      codes.append(Instruction::RET);
+      codes.set_local_size(parser.toplevel_val_size());
+      n_tokens = tokens.count();
+      token_bytes = tokens.memory_bytes();
+      arena_bytes = arena->allocated_bytes();
+      LoopOptimizer(&codes).optimize();
+      Bytecode::save(codes, source_hash, source->size(), parser.imports());
+    }
+    Heap::get().add_root(&codes);
+  } catch (const SyntaxError &e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
   }
+  // a module importing the program does not run it again
+  ModuleLoader::get().add_loaded(bundled != nullptr
+                                     ? bundled->main_path()
+                                     : ModuleLoader::canonical(src),
+                                 &codes);
 
-  holang::Parser parser(token_chain);
-  Node *root = parser.parse();
-  CodeSequence codes(src);
-  // codes.push_back({.op = Instruction::PUT_ENV});
-  // codes.push_back({.ival = 0});
-  if (root == nullptr) {
-    return 0;
+  if (show_compile_stats) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    if (cached) {
+      cerr << "compile: cached bytecode, ";
+    } else {
+      cerr << "compile: " << n_tokens << " tokens through a " << token_bytes
+           << " byte window, " << arena_bytes << " arena bytes, ";
+    }
+    cerr << usage.ru_maxrss << " KiB peak RSS" << endl;
   }
-  if (show_ast) {
-    root->print(0);
+  if (compile_only) {
     return 0;
   }
-  root->code_gen(&codes);
-  // codes[1].ival = size_local_idents();
 
-  HolangVM vm(parser.toplevel_val_size());
-  vm.codes = &codes;
-  vm.eval();
+  int status = 0;
+  {
+    HolangVM vm(codes.local_size());
+    vm.codes = &codes;
+    // counted from the start of the run, not of compilation
+    HolangVM::set_time_limit(time_limit);
+    try {
+      vm.eval();
+    } catch (const RaiseException &e) {
+      Value exception = e.value;
+      std::cerr << "uncaught exception: " << exception.to_s() << std::endl;
+      status = 1;
+    } catch (const LimitExceeded &e) {
+      std::cerr << "aborted: " << e.what() << std::endl;
+      status = 2;
+    } catch (const SyntaxError &e) { // in an imported module
+      std::cerr << e.what() << std::endl;
+      status = 1;
+    }
+  }
+  if (show_gc_stats) {
+    Heap::get().print_stats(cerr);
+  }
+  return status;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc >= 2 && string(argv[1]) == "--server") {
+    if (argc != 3) {
+      cerr << "usage: ho --server SOCKET" << endl;
+      return -1;
+    }
+    return serve(argv[2], run);
+  }
+  return run(argc, argv);
 }
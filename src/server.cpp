@@ -0,0 +1,216 @@
+#include "server.hpp"
+#include "config.hpp"
+#include "holang/loader.hpp"
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <iostream>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+using namespace holang;
+
+namespace {
+int child_exited[2]; // written by the SIGCHLD handler, polled by the server
+
+void on_child_exit(int) {
+  int saved = errno;
+  char byte = 0;
+  if (write(child_exited[1], &byte, 1) < 0) {
+    // full: the server is reaping anyway
+  }
+  errno = saved;
+}
+
+// the modules of holib, which scripts import by name
+vector<string> holib_modules() {
+  vector<string> paths;
+#ifdef PATH_HOLIB
+  if (DIR *dir = opendir(PATH_HOLIB)) {
+    while (struct dirent *entry = readdir(dir)) {
+      string name = entry->d_name;
+      if (name.size() > 3 && name.compare(name.size() - 3, 3, ".ho") == 0) {
+        paths.push_back(string(PATH_HOLIB) + "/" + name);
+      }
+    }
+    closedir(dir);
+  }
+#endif
+  return paths;
+}
+
+bool read_all(int fd, char *data, size_t size) {
+  while (size > 0) {
+    ssize_t n = read(fd, data, size);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    data += n;
+    size -= n;
+  }
+  return true;
+}
+
+// In the child: takes the stdio of the client and runs the script it asks
+// for, as ho would.
+[[noreturn]] void run_request(int conn, int (*run)(int, char *[])) {
+  uint32_t size = 0;
+  int fds[3];
+  char control[CMSG_SPACE(sizeof(fds))];
+  struct iovec iov = {&size, sizeof(size)};
+  struct msghdr message;
+  memset(&message, 0, sizeof(message));
+  message.msg_iov = &iov;
+  message.msg_iovlen = 1;
+  message.msg_control = control;
+  message.msg_controllen = sizeof(control);
+  ssize_t n = recvmsg(conn, &message, MSG_WAITALL | MSG_CMSG_CLOEXEC);
+  struct cmsghdr *fd_message = CMSG_FIRSTHDR(&message);
+  if (n != sizeof(size) || fd_message == nullptr ||
+      fd_message->cmsg_type != SCM_RIGHTS ||
+      fd_message->cmsg_len != CMSG_LEN(sizeof(fds)) ||
+      size > max_server_request) {
+    _exit(1);
+  }
+  memcpy(fds, CMSG_DATA(fd_message), sizeof(fds));
+  for (int i = 0; i < 3; i++) {
+    dup2(fds[i], i);
+    if (fds[i] > 2) {
+      close(fds[i]);
+    }
+  }
+
+  string request(size, '\0');
+  if (!read_all(conn, &request[0], size) || request.empty() ||
+      request.back() != '\0') {
+    _exit(1);
+  }
+  close(conn);
+  vector<char *> args;
+  for (size_t i = 0; i < request.size(); i = request.find('\0', i) + 1) {
+    args.push_back(&request[i]);
+  }
+  if (chdir(args[0]) != 0) {
+    cerr << args[0] << ": " << strerror(errno) << endl;
+    exit(1);
+  }
+  args[0] = (char *)"ho";
+  args.push_back(nullptr);
+  int status = run(args.size() - 1, args.data());
+  // the heap and loader go with the process, there is nothing to tear down
+  cout.flush();
+  cerr.flush();
+  fflush(nullptr);
+  _exit(status);
+}
+} // namespace
+
+int holang::serve(const string &socket_path, int (*run)(int, char *[])) {
+  // bound aside and renamed once it listens, so a client that finds it can
+  // connect; only by the same user, whatever the umask, as scripts run with
+  // the server's rights
+  string bound_path = socket_path + "." + to_string(getpid());
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (bound_path.size() >= sizeof(address.sun_path)) {
+    cerr << socket_path << ": socket path too long" << endl;
+    return -1;
+  }
+  strcpy(address.sun_path, bound_path.c_str());
+  int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  unlink(bound_path.c_str());
+  if (listener < 0 ||
+      bind(listener, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+      chmod(bound_path.c_str(), 0600) != 0 ||
+      listen(listener, SOMAXCONN) != 0 ||
+      rename(bound_path.c_str(), socket_path.c_str()) != 0) {
+    cerr << socket_path << ": " << strerror(errno) << endl;
+    unlink(bound_path.c_str());
+    return -1;
+  }
+
+  // what every script would do first; holib is parsed or mapped, and the
+  // children take it from the loader instead of reading it again
+  ModuleLoader::get().prepare(holib_modules());
+
+  if (pipe2(child_exited, O_CLOEXEC | O_NONBLOCK) != 0) {
+    cerr << "pipe: " << strerror(errno) << endl;
+    return -1;
+  }
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = on_child_exit;
+  action.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+  sigaction(SIGCHLD, &action, nullptr);
+
+  unordered_map<pid_t, int> clients; // the connection of each child
+  while (true) {
+    struct pollfd events[2] = {{listener, POLLIN, 0},
+                               {child_exited[0], POLLIN, 0}};
+    if (poll(events, 2, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      cerr << "poll: " << strerror(errno) << endl;
+      return -1;
+    }
+
+    if (events[1].revents & POLLIN) {
+      char bytes[64];
+      while (read(child_exited[0], bytes, sizeof(bytes)) > 0) {
+      }
+      int status;
+      pid_t pid;
+      while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        auto it = clients.find(pid);
+        if (it == clients.end()) {
+          continue;
+        }
+        int32_t reply = status;
+        send(it->second, &reply, sizeof(reply), MSG_NOSIGNAL);
+        close(it->second);
+        clients.erase(it);
+      }
+    }
+
+    if (events[0].revents & POLLIN) {
+      int conn = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+      if (conn < 0) {
+        continue;
+      }
+      cout.flush();
+      cerr.flush();
+      pid_t pid = fork();
+      if (pid == 0) {
+        signal(SIGCHLD, SIG_DFL);
+        close(listener);
+        close(child_exited[0]);
+        close(child_exited[1]);
+        for (const auto &client : clients) {
+          close(client.second);
+        }
+        run_request(conn, run);
+      }
+      if (pid < 0) {
+        close(conn);
+        continue;
+      }
+      // reaped by the next poll, even when it exited already
+      clients.emplace(pid, conn);
+    }
+  }
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// ho --server SOCKET: a process that has started and loaded holib once,
+// and forks a child for each script a client asks it to run. The child
+// starts from a copy of it, so scripts do not see each other.
+//
+// A client connects to the unix socket at SOCKET and sends, in one
+// message, its stdin, stdout and stderr as SCM_RIGHTS with the length of
+// the request as a uint32. The request follows: the working directory,
+// then the arguments ho would take, each ended by NUL. Once the script
+// ends, the server replies with its wait status as an int32 and closes the
+// connection.
+namespace holang {
+const uint32_t max_server_request = 1 << 20;
+
+// serves until killed; run is the main of ho, called in each child
+int serve(const std::string &socket_path, int (*run)(int, char *[]));
+} // namespace holang
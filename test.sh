@@ -3,23 +3,108 @@ tmpfile=$(mktemp)
 
 pass=0
 fail=0
-for src in $codes; do
-  base=$(basename $src .ho)
-  testfile="test/${base}.out"
-  printf "$src: "
-  build/ho $src 1> $tmpfile
-  diff $tmpfile $testfile -u
+
+# compares what was run, in $tmpfile, with the expected output
+check() {
+  diff $tmpfile $2 -u
   if [ $? = 0 ]; then
     printf "\e[32m"
     echo "PASS"
     pass=`expr $pass + 1`
   else
     printf "\e[31m"
-    echo "$src: FAIL"
+    echo "$1: FAIL"
     fail=`expr $fail + 1`
   fi
   printf "\e[m"
+}
+
+for src in $codes; do
+  base=$(basename $src .ho)
+  testfile="test/${base}.out"
+  printf "$src: "
+  build/ho $src 1> $tmpfile
+  check $src $testfile
+done
+
+# a bundle runs as its sources do, from anywhere
+bundledir=$(mktemp -d)
+printf "examples/bundle.ho as a bundle: "
+build/ho bundle examples/bundle.ho -o $bundledir/app.hob 2> /dev/null
+(cd $bundledir && $OLDPWD/build/ho app.hob) 1> $tmpfile
+check "examples/bundle.ho as a bundle" test/bundle.out
+rm -r $bundledir
+
+# a run over a limit is aborted with status 2, past any try in the script
+errfile=$(mktemp)
+limit() {
+  printf "examples/limit/$1 with $2: "
+  build/ho examples/limit/$1 $2 1> $tmpfile 2> $errfile
+  echo "status $?" >> $tmpfile
+  grep -o "aborted: [a-z]* limit exceeded" $errfile >> $tmpfile
+  check "examples/limit/$1 with $2" test/$3
+}
+limit loop.ho --step-limit=1000 limit_steps.out
+limit loop.ho --time-limit=100 limit_time.out
+limit alloc.ho --heap-limit=10m limit_heap.out
+limit recursion.ho --heap-limit=10m limit_heap.out
+limit import.ho --heap-limit=10m limit_import.out
+rm $errfile
+
+# an integer literal that does not fit in an int does not parse
+printf "examples/syntax/int_range.ho: "
+build/ho examples/syntax/int_range.ho 1> $tmpfile 2>&1
+echo "status $?" >> $tmpfile
+check examples/syntax/int_range.ho test/int_range.out
+
+# nor does a case giving a label twice
+printf "examples/syntax/case_label.ho: "
+build/ho examples/syntax/case_label.ho 1> $tmpfile 2>&1
+echo "status $?" >> $tmpfile
+check examples/syntax/case_label.ho test/case_label.out
+
+# a damaged cache entry is compiled again
+cachedir=$(mktemp -d)
+build/ho examples/sealed.ho --cache-dir=$cachedir > /dev/null
+for entry in $cachedir/*.hoc; do
+  printf '\377' | dd of=$entry bs=1 seek=100 conv=notrunc 2> /dev/null
+done
+printf "examples/sealed.ho from a damaged cache: "
+build/ho examples/sealed.ho --cache-dir=$cachedir 1> $tmpfile
+check "examples/sealed.ho from a damaged cache" test/sealed.out
+rm -r $cachedir
+
+# as is one written by another build of the compiler: the build id is the
+# 8 bytes after the magic and version, and the entry is written again
+cachedir=$(mktemp -d)
+build/ho examples/sealed.ho --cache-dir=$cachedir > /dev/null
+entry=$(ls $cachedir/*.hoc)
+build_id=$(od -An -tx1 -j8 -N8 $entry)
+printf '\0\0\0\0\0\0\0\0' | dd of=$entry bs=1 seek=8 conv=notrunc 2> /dev/null
+printf "examples/sealed.ho from another build's cache: "
+build/ho examples/sealed.ho --cache-dir=$cachedir 1> $tmpfile
+if [ "$(od -An -tx1 -j8 -N8 $entry)" != "$build_id" ]; then
+  echo "cache entry of another build was used" > $tmpfile
+fi
+check "examples/sealed.ho from another build's cache" test/sealed.out
+rm -r $cachedir
+
+# and so does a script a server runs
+serverdir=$(mktemp -d)
+(umask 0 && exec build/ho --server $serverdir/ho.sock) &
+server=$!
+while [ ! -S $serverdir/ho.sock ] && kill -0 $server 2> /dev/null; do
+  sleep 0.01
 done
+# only its own user can connect, whatever the umask
+printf "the socket of a server: "
+stat -c %a $serverdir/ho.sock 1> $tmpfile
+check "the socket of a server" test/server_socket.out
+printf "examples/import.ho on a server: "
+build/ho-client $serverdir/ho.sock examples/import.ho 1> $tmpfile
+check "examples/import.ho on a server" test/import.out
+kill $server
+rm -r $serverdir
 
 rm $tmpfile
 